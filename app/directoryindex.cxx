@@ -0,0 +1,121 @@
+#include "directoryindex.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cctype>
+#include <dirent.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "runcache.h"
+
+static String MakeKey(String const &Name)
+{
+#ifdef _WIN32
+	// Windows filenames are case insensitive
+	String Out = Name;
+	for (auto &Character : Out) Character = tolower(Character);
+	return Out;
+#else
+	return Name;
+#endif
+}
+
+DirectoryIndex::DirectoryIndex(DirectoryPath const &Directory) : Directory(Directory), Listed(false)
+{
+	String const Path = Directory.AsAbsoluteString();
+	RecordDependency(Path);
+	auto Add = [&](char const *Name, bool Regular)
+	{
+		if ((Name[0] == '.') && ((Name[1] == 0) || ((Name[1] == '.') && (Name[2] == 0)))) return;
+		Names.push_back(Name);
+		Entries[MakeKey(Names.back())] = Regular ? EntryStates::Present : EntryStates::Unconfirmed;
+	};
+
+#ifdef __linux__
+	// getdents64 reads many entries per call, and glibc doesn't wrap it before 2.30
+	struct LinuxDirectoryEntry
+	{
+		uint64_t Inode;
+		int64_t Offset;
+		unsigned short Length;
+		unsigned char Type;
+		char Name[1];
+	};
+	int Descriptor = open(Path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (Descriptor == -1)
+	{
+		// A missing directory is listed as empty, but one we may not read has to be checked name by name
+		if ((errno == ENOENT) || (errno == ENOTDIR)) Listed = true;
+		return;
+	}
+	std::vector<char> Buffer(32 * 1024);
+	while (true)
+	{
+		long Read = syscall(SYS_getdents64, Descriptor, Buffer.data(), Buffer.size());
+		if (Read == -1)
+		{
+			if (errno == EINTR) continue;
+			close(Descriptor);
+			Names.clear();
+			Entries.clear();
+			return;
+		}
+		if (Read == 0) break;
+		for (long Offset = 0; Offset < Read; )
+		{
+			LinuxDirectoryEntry const *Entry = reinterpret_cast<LinuxDirectoryEntry const *>(Buffer.data() + Offset);
+			Add(Entry->Name, Entry->Type == DT_REG);
+			Offset += Entry->Length;
+		}
+	}
+	close(Descriptor);
+#else
+	DIR *Listing = opendir(Path.c_str());
+	if (Listing == nullptr)
+	{
+		if ((errno == ENOENT) || (errno == ENOTDIR)) Listed = true;
+		return;
+	}
+	while (dirent *Entry = readdir(Listing))
+	{
+#ifdef _DIRENT_HAVE_D_TYPE
+		Add(Entry->d_name, Entry->d_type == DT_REG);
+#else
+		Add(Entry->d_name, false);
+#endif
+	}
+	closedir(Listing);
+#endif
+	Listed = true;
+}
+
+DirectoryPath const &DirectoryIndex::GetDirectory(void) const { return Directory; }
+
+bool DirectoryIndex::Contains(String const &Name)
+{
+	Answers const Answer = Check(Name);
+	if (Answer != Answers::Unknown) return Answer == Answers::Yes;
+	bool const Present = Directory.Select(Name).Exists();
+	Confirm(Name, Present);
+	return Present;
+}
+
+DirectoryIndex::Answers DirectoryIndex::Check(String const &Name) const
+{
+	auto Found = Entries.find(MakeKey(Name));
+	if (Found == Entries.end()) return Listed ? Answers::No : Answers::Unknown;
+	if (Found->second == EntryStates::Unconfirmed) return Answers::Unknown;
+	return Found->second == EntryStates::Present ? Answers::Yes : Answers::No;
+}
+
+void DirectoryIndex::Confirm(String const &Name, bool Present)
+	{ Entries[MakeKey(Name)] = Present ? EntryStates::Present : EntryStates::Missing; }
+
+std::vector<String> const &DirectoryIndex::GetNames(void) const { return Names; }
+
+bool DirectoryIndex::IsComplete(void) const { return Listed; }
+
@@ -0,0 +1,32 @@
+#ifndef DIRECTORYINDEX_H
+#define DIRECTORYINDEX_H
+
+#include <unordered_map>
+
+#include "ren-general/string.h"
+#include "ren-general/filesystem.h"
+
+// The names in a directory, read once so that lookups are answered from memory.  Entries that might be dangling symbolic links are confirmed with the filesystem the first time they're looked up, so Contains gives the same answer as Directory.Select(Name).Exists().
+class DirectoryIndex
+{
+	public:
+		DirectoryIndex(DirectoryPath const &Directory);
+		DirectoryPath const &GetDirectory(void) const;
+		bool Contains(String const &Name);
+		enum struct Answers { Yes, No, Unknown };
+		Answers Check(String const &Name) const; // Like Contains, but answers Unknown instead of going to the filesystem
+		void Confirm(String const &Name, bool Present); // Records the filesystem's answer for a name Check didn't know
+		std::vector<String> const &GetNames(void) const; // In directory order
+		bool IsComplete(void) const; // False if the directory couldn't be read, in which case GetNames is empty
+
+	private:
+		enum struct EntryStates { Present, Unconfirmed, Missing };
+
+		DirectoryPath const Directory;
+		bool Listed; // If the directory couldn't be read, each name is checked with the filesystem the first time it's looked up
+		std::unordered_map<String, EntryStates> Entries;
+		std::vector<String> Names;
+};
+
+#endif // DIRECTORYINDEX_H
+
@@ -0,0 +1,257 @@
+#include "filesystemprobe.h"
+
+#include <memory>
+#include <algorithm>
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <sys/stat.h>
+#ifndef WINDOWS
+#include <atomic>
+#include <thread>
+#endif
+#if defined(__linux__) && defined(STATX_BASIC_STATS) && __has_include(<linux/io_uring.h>)
+#define PROBE_WITH_IO_URING
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "shared.h"
+#include "runcache.h"
+
+extern bool Verbose;
+
+static PathStatus StatPath(String const &Path)
+{
+	PathStatus Out{false, false, false};
+	struct stat Status;
+	if (stat(Path.c_str(), &Status) != 0) return Out;
+	Out.Exists = true;
+	Out.IsDirectory = S_ISDIR(Status.st_mode);
+#ifndef WINDOWS
+	Out.IsExecutable = !Out.IsDirectory && ((Status.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0);
+#else
+	Out.IsExecutable = !Out.IsDirectory;
+#endif
+	return Out;
+}
+
+static void ProbeWithThreads(std::vector<String> const &Paths, std::vector<PathStatus> &Out)
+{
+#ifndef WINDOWS
+	size_t const MaximumThreads = 8;
+	if (Paths.size() > 1)
+	{
+		std::atomic<size_t> Next(0);
+		auto Work = [&](void)
+		{
+			for (size_t Index = Next++; Index < Paths.size(); Index = Next++)
+				Out[Index] = StatPath(Paths[Index]);
+		};
+		std::vector<std::thread> Threads;
+		try
+		{
+			for (size_t Count = 1; Count < std::min(Paths.size(), MaximumThreads); ++Count)
+				Threads.emplace_back(Work);
+		}
+		catch (std::system_error &) {} // The threads that did start, and this one, still finish the list
+		Work();
+		for (auto &Thread : Threads) Thread.join();
+		return;
+	}
+#endif
+	for (size_t Index = 0; Index < Paths.size(); ++Index)
+		Out[Index] = StatPath(Paths[Index]);
+}
+
+#ifdef PROBE_WITH_IO_URING
+// A minimal io_uring used only for statx.  glibc doesn't wrap the io_uring system calls, and liburing isn't a dependency.
+class StatusRing
+{
+	public:
+		StatusRing(void);
+		~StatusRing(void);
+		bool IsUsable(void) const;
+		bool Probe(std::vector<String> const &Paths, std::vector<PathStatus> &Out); // Returns false if the ring stopped working; Out is then incomplete
+
+	private:
+		int Descriptor;
+		bool Usable;
+		unsigned int SubmissionCount, CompletionCount;
+		void *SubmissionMap, *CompletionMap, *EntryMap;
+		size_t SubmissionMapSize, CompletionMapSize, EntryMapSize;
+		unsigned int *SubmissionHead, *SubmissionTail, *SubmissionMask, *SubmissionArray;
+		unsigned int *CompletionHead, *CompletionTail, *CompletionMask;
+		io_uring_sqe *Entries;
+		io_uring_cqe *Completions;
+
+		// Requests in flight point here, so these must outlive any request the kernel may still be working on
+		std::vector<String> Names;
+		std::vector<struct statx> Results;
+};
+
+StatusRing::StatusRing(void) :
+	Descriptor(-1), Usable(false),
+	SubmissionMap(MAP_FAILED), CompletionMap(MAP_FAILED), EntryMap(MAP_FAILED),
+	SubmissionMapSize(0), CompletionMapSize(0), EntryMapSize(0)
+{
+	io_uring_params Parameters;
+	memset(&Parameters, 0, sizeof(Parameters));
+	Descriptor = syscall(__NR_io_uring_setup, 64, &Parameters);
+	if (Descriptor == -1) return; // Missing before Linux 5.1 and often blocked in containers
+
+	// IORING_OP_STATX needs Linux 5.6, which is also when probing for supported operations appeared
+	std::vector<char> ProbeBuffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+	io_uring_probe *Supported = reinterpret_cast<io_uring_probe *>(ProbeBuffer.data());
+	if ((syscall(__NR_io_uring_register, Descriptor, IORING_REGISTER_PROBE, Supported, 256) == -1) ||
+		(Supported->last_op < IORING_OP_STATX) ||
+		!(Supported->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED))
+		return;
+
+	SubmissionCount = Parameters.sq_entries;
+	CompletionCount = Parameters.cq_entries;
+	SubmissionMapSize = Parameters.sq_off.array + Parameters.sq_entries * sizeof(unsigned int);
+	CompletionMapSize = Parameters.cq_off.cqes + Parameters.cq_entries * sizeof(io_uring_cqe);
+	if (Parameters.features & IORING_FEAT_SINGLE_MMAP)
+		SubmissionMapSize = CompletionMapSize = std::max(SubmissionMapSize, CompletionMapSize);
+	SubmissionMap = mmap(nullptr, SubmissionMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Descriptor, IORING_OFF_SQ_RING);
+	if (SubmissionMap == MAP_FAILED) return;
+	if (Parameters.features & IORING_FEAT_SINGLE_MMAP) CompletionMap = SubmissionMap;
+	else
+	{
+		CompletionMap = mmap(nullptr, CompletionMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Descriptor, IORING_OFF_CQ_RING);
+		if (CompletionMap == MAP_FAILED) return;
+	}
+	EntryMapSize = Parameters.sq_entries * sizeof(io_uring_sqe);
+	EntryMap = mmap(nullptr, EntryMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Descriptor, IORING_OFF_SQES);
+	if (EntryMap == MAP_FAILED) return;
+
+	char *Submission = static_cast<char *>(SubmissionMap), *Completion = static_cast<char *>(CompletionMap);
+	SubmissionHead = reinterpret_cast<unsigned int *>(Submission + Parameters.sq_off.head);
+	SubmissionTail = reinterpret_cast<unsigned int *>(Submission + Parameters.sq_off.tail);
+	SubmissionMask = reinterpret_cast<unsigned int *>(Submission + Parameters.sq_off.ring_mask);
+	SubmissionArray = reinterpret_cast<unsigned int *>(Submission + Parameters.sq_off.array);
+	CompletionHead = reinterpret_cast<unsigned int *>(Completion + Parameters.cq_off.head);
+	CompletionTail = reinterpret_cast<unsigned int *>(Completion + Parameters.cq_off.tail);
+	CompletionMask = reinterpret_cast<unsigned int *>(Completion + Parameters.cq_off.ring_mask);
+	Completions = reinterpret_cast<io_uring_cqe *>(Completion + Parameters.cq_off.cqes);
+	Entries = static_cast<io_uring_sqe *>(EntryMap);
+	Usable = true;
+}
+
+StatusRing::~StatusRing(void)
+{
+	if (EntryMap != MAP_FAILED) munmap(EntryMap, EntryMapSize);
+	if ((CompletionMap != MAP_FAILED) && (CompletionMap != SubmissionMap)) munmap(CompletionMap, CompletionMapSize);
+	if (SubmissionMap != MAP_FAILED) munmap(SubmissionMap, SubmissionMapSize);
+	if (Descriptor != -1) close(Descriptor);
+}
+
+bool StatusRing::IsUsable(void) const { return Usable; }
+
+bool StatusRing::Probe(std::vector<String> const &Paths, std::vector<PathStatus> &Out)
+{
+	Names = Paths;
+	struct statx const Blank{};
+	Results.assign(Paths.size(), Blank);
+	size_t Submitted = 0, Completed = 0;
+	while (Completed < Names.size())
+	{
+		// Queue as many requests as the rings have room for
+		unsigned int Tail = *SubmissionTail;
+		unsigned int const Head = __atomic_load_n(SubmissionHead, __ATOMIC_ACQUIRE);
+		while ((Submitted < Names.size()) && (Tail - Head < SubmissionCount) && (Submitted - Completed < CompletionCount))
+		{
+			unsigned int const Slot = Tail & *SubmissionMask;
+			io_uring_sqe &Entry = Entries[Slot];
+			memset(&Entry, 0, sizeof(Entry));
+			Entry.opcode = IORING_OP_STATX;
+			Entry.fd = AT_FDCWD;
+			Entry.addr = reinterpret_cast<uintptr_t>(Names[Submitted].c_str());
+			Entry.len = STATX_TYPE | STATX_MODE;
+			Entry.off = reinterpret_cast<uintptr_t>(&Results[Submitted]);
+			Entry.user_data = Submitted;
+			SubmissionArray[Slot] = Slot;
+			++Tail;
+			++Submitted;
+		}
+		__atomic_store_n(SubmissionTail, Tail, __ATOMIC_RELEASE);
+
+		// Entries an interrupted or short submission left behind are still between Head and Tail, so they're submitted again along with the new ones
+		if (syscall(__NR_io_uring_enter, Descriptor, Tail - Head, 1, IORING_ENTER_GETEVENTS, nullptr, 0) == -1)
+		{
+			if ((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY))
+			{
+				// Requests may still be pending, so leave Names and Results alone and stop using the ring
+				Usable = false;
+				return false;
+			}
+		}
+
+		unsigned int CompletionIndex = *CompletionHead;
+		unsigned int const CompletionEnd = __atomic_load_n(CompletionTail, __ATOMIC_ACQUIRE);
+		for (; CompletionIndex != CompletionEnd; ++CompletionIndex)
+		{
+			io_uring_cqe const &Completion = Completions[CompletionIndex & *CompletionMask];
+			size_t const Index = Completion.user_data;
+			PathStatus &Status = Out[Index];
+			Status.Exists = Completion.res == 0;
+			Status.IsDirectory = Status.Exists && S_ISDIR(Results[Index].stx_mode);
+			Status.IsExecutable = Status.Exists && !Status.IsDirectory && ((Results[Index].stx_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0);
+			++Completed;
+		}
+		__atomic_store_n(CompletionHead, CompletionIndex, __ATOMIC_RELEASE);
+	}
+	return true;
+}
+
+static StatusRing *GetStatusRing(void)
+{
+	static std::unique_ptr<StatusRing> Ring;
+	static bool Prepared = false;
+	if (!Prepared)
+	{
+		Prepared = true;
+		Ring.reset(new StatusRing());
+		if (Verbose && !Ring->IsUsable()) StandardStream << "io_uring statx isn't available; probing paths with threads instead.\n" << OutputStream::Flush();
+	}
+	if (!Ring->IsUsable()) return nullptr;
+	return Ring.get();
+}
+#endif
+
+std::vector<PathStatus> ProbePaths(std::vector<String> const &Paths)
+{
+	std::vector<PathStatus> Out(Paths.size(), PathStatus{false, false, false});
+	if (Paths.empty()) return Out;
+	// Paths appearing or disappearing change their directories, which are far fewer than the candidates
+	for (auto &Path : Paths)
+	{
+		size_t const Slash = Path.find_last_of('/', Path.find_last_not_of('/'));
+		if (Slash != String::npos) RecordDependency(Slash == 0 ? String("/") : Path.substr(0, Slash));
+	}
+	if (Paths.size() == 1)
+	{
+		Out[0] = StatPath(Paths[0]);
+		return Out;
+	}
+#ifdef PROBE_WITH_IO_URING
+	StatusRing *Ring = GetStatusRing();
+	if ((Ring != nullptr) && Ring->Probe(Paths, Out)) return Out;
+#endif
+	ProbeWithThreads(Paths, Out);
+	return Out;
+}
+
+int FindFirstPath(std::vector<String> const &Paths, std::function<bool(String const &Path, PathStatus const &Status)> const &Accept)
+{
+	std::vector<PathStatus> const Statuses = ProbePaths(Paths);
+	for (size_t Index = 0; Index < Statuses.size(); ++Index)
+		if (Accept(Paths[Index], Statuses[Index])) return Index;
+	return -1;
+}
+
@@ -0,0 +1,21 @@
+#ifndef FILESYSTEMPROBE_H
+#define FILESYSTEMPROBE_H
+
+#include <vector>
+#include <functional>
+
+#include "ren-general/string.h"
+
+struct PathStatus
+{
+	bool Exists, IsDirectory, IsExecutable; // IsExecutable only reflects the mode bits, not whether this process may run the file
+};
+
+// Examines every path at once.  On Linux the statx calls are submitted together through io_uring; elsewhere, or if the kernel doesn't allow it, they're spread over a few threads.  Either way a list of candidates costs about one filesystem round trip rather than one per path.
+std::vector<PathStatus> ProbePaths(std::vector<String> const &Paths);
+
+// Probes every path at once like ProbePaths, then returns the index of the first path, in list order, that Accept takes, or -1 if there is none.  Accept is only called for paths in order until one is taken, so it can make further checks of its own.
+int FindFirstPath(std::vector<String> const &Paths, std::function<bool(String const &Path, PathStatus const &Status)> const &Accept);
+
+#endif // FILESYSTEMPROBE_H
+
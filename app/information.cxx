@@ -1,6 +1,187 @@
 #include "information.h"
 
-String GetArgument(Script &State, String const &Name)
+#include "runcache.h"
+
+extern RunCache RunResults;
+extern LockFile LockResults;
+extern bool Verbose;
+
+void Response::Replay(QueryState &State) const
+{
+	for (auto &Current : Steps)
+		switch (Current.Operation)
+		{
+			case Operations::Table: State.PushTable(); break;
+			case Operations::String: State.PushString(Current.Text); break;
+			case Operations::Integer: State.PushInteger(Current.Number); break;
+			case Operations::Boolean: State.PushBoolean(Current.Number != 0); break;
+			case Operations::Element: State.PutElement(Current.Text); break;
+			case Operations::Index: State.PutElement(static_cast<unsigned int>(Current.Number)); break;
+		}
+}
+
+QueryState::QueryState(Script &State, unsigned int Base) : State(State), Base(Base) {}
+
+void QueryState::PushTable(void)
+{
+	Result.Steps.push_back(Response::Step{Response::Operations::Table, String(), 0});
+	State.PushTable();
+}
+
+void QueryState::PushString(String const &Value)
+{
+	Result.Steps.push_back(Response::Step{Response::Operations::String, Value, 0});
+	State.PushString(Value);
+}
+
+void QueryState::PushInteger(long Value)
+{
+	Result.Steps.push_back(Response::Step{Response::Operations::Integer, String(), Value});
+	State.PushInteger(Value);
+}
+
+void QueryState::PushBoolean(bool Value)
+{
+	Result.Steps.push_back(Response::Step{Response::Operations::Boolean, String(), Value ? 1 : 0});
+	State.PushBoolean(Value);
+}
+
+void QueryState::PutElement(String const &Name)
+{
+	Result.Steps.push_back(Response::Step{Response::Operations::Element, Name, 0});
+	State.PutElement(Name);
+}
+
+void QueryState::PutElement(unsigned int Index)
+{
+	Result.Steps.push_back(Response::Step{Response::Operations::Index, String(), Index});
+	State.PutElement(Index);
+}
+
+// Arguments are only ever pulled from the argument table, so pulling an element is reading an argument
+void QueryState::PullElement(String const &Name)
+{
+	NoteArgument(Name);
+	State.PullElement(Name);
+}
+
+bool QueryState::TryElement(String const &Name)
+{
+	NoteArgument(Name);
+	return State.TryElement(Name);
+}
+
+void QueryState::AssertTable(String const &Message) { State.AssertTable(Message); }
+void QueryState::AssertString(String const &Message) { State.AssertString(Message); }
+void QueryState::AssertBoolean(String const &Message) { State.AssertBoolean(Message); }
+void QueryState::AssertNumber(String const &Message) { State.AssertNumber(Message); }
+bool QueryState::IsTable(void) { return State.IsTable(); }
+bool QueryState::IsString(void) { return State.IsString(); }
+String QueryState::GetType(void) { return State.GetType(); }
+String QueryState::GetString(void) { return State.GetString(); }
+bool QueryState::GetBoolean(void) { return State.GetBoolean(); }
+unsigned int QueryState::GetUnsignedInteger(void) { return State.GetUnsignedInteger(); }
+void QueryState::Iterate(std::function<bool(Script &State)> const &Callback) { State.Iterate(Callback); }
+void QueryState::Pop(void) { State.Pop(); }
+unsigned int QueryState::Height(void) { return State.Height() - Base; }
+
+String QueryState::DescribeArgument(String const &Name)
+{
+	if (!State.IsTable()) return String();
+	if (!State.TryElement(Name)) return "nil";
+	return DescribeValue();
+}
+
+String QueryState::DescribeValue(void)
+{
+	// Consumes the value on top of the stack
+	if (State.IsTable())
+	{
+		MemoryStream Out;
+		Out << "{";
+		State.Iterate([&](Script &) { Out << DescribeValue() << ","; return true; });
+		State.Pop();
+		Out << "}";
+		return Out;
+	}
+	String const Type = State.GetType();
+	if (Type == "boolean") return State.GetBoolean() ? "true" : "false";
+	if (State.IsString()) return "\"" + State.GetString() + "\"";
+	State.Pop();
+	return Type;
+}
+
+void QueryState::NoteArgument(String const &Name)
+{
+	for (auto &Argument : Arguments)
+		if (Argument.first == Name) return;
+	Arguments.push_back(std::make_pair(Name, DescribeArgument(Name)));
+}
+
+bool QueryState::MatchArguments(std::vector<std::pair<String, String> > const &Arguments)
+{
+	for (auto &Argument : Arguments)
+		if (DescribeArgument(Argument.first) != Argument.second) return false;
+	this->Arguments = Arguments;
+	return true;
+}
+
+std::vector<std::pair<String, String> > const &QueryState::GetArguments(void) const { return Arguments; }
+
+ArgumentCopies QueryState::CopyArguments(void)
+{
+	ArgumentCopies Out;
+	for (auto &Argument : Arguments)
+		if (State.IsTable() && State.TryElement(Argument.first))
+			Out.push_back(std::make_pair(Argument.first, CopyValue()));
+	return Out;
+}
+
+void QueryState::PushArguments(ArgumentCopies const &Arguments)
+{
+	State.PushTable();
+	for (auto &Argument : Arguments)
+	{
+		PushValue(Argument.second);
+		State.PutElement(Argument.first);
+	}
+}
+
+ArgumentCopy QueryState::CopyValue(void)
+{
+	// Consumes the value on top of the stack, like DescribeValue
+	ArgumentCopy Out{State.GetType(), String(), false, 0, {}};
+	if (State.IsTable())
+	{
+		State.Iterate([&](Script &) { Out.Elements.push_back(CopyValue()); return true; });
+		State.Pop();
+	}
+	else if (Out.Type == "boolean") Out.Flag = State.GetBoolean();
+	else if (Out.Type == "number") Out.Number = State.GetUnsignedInteger();
+	else if (State.IsString()) Out.Text = State.GetString();
+	else State.Pop();
+	return Out;
+}
+
+void QueryState::PushValue(ArgumentCopy const &Value)
+{
+	if (Value.Type == "table")
+	{
+		State.PushTable();
+		for (unsigned int Index = 1; Index <= Value.Elements.size(); ++Index)
+		{
+			PushValue(Value.Elements[Index - 1]);
+			State.PutElement(Index);
+		}
+	}
+	else if (Value.Type == "boolean") State.PushBoolean(Value.Flag);
+	else if (Value.Type == "number") State.PushInteger(Value.Number);
+	else State.PushString(Value.Text);
+}
+
+Response const &QueryState::GetResponse(void) const { return Result; }
+
+String GetArgument(QueryState &State, String const &Name)
 {
 	State.AssertTable("Arguments must be passed to this function in a table.  It appears that you passed in a " + State.GetType() + ".");
 	State.PullElement(Name);
@@ -11,7 +192,7 @@ String GetArgument(Script &State, String const &Name)
 	return Out;
 }
 
-std::vector<String> GetVariableArgument(Script &State, String const &Name)
+std::vector<String> GetVariableArgument(QueryState &State, String const &Name)
 {
 #ifndef NDEBUG
 	unsigned int const InitialHeight = State.Height();
@@ -41,7 +222,7 @@ std::vector<String> GetVariableArgument(Script &State, String const &Name)
 	return Out;
 }
 
-String GetOptionalArgument(Script &State, String const &Name)
+String GetOptionalArgument(QueryState &State, String const &Name)
 {
 	State.AssertTable("Arguments must be passed to this function in a table.  It appears that you passed in a " + State.GetType() + ".");
 	if (!State.TryElement(Name))
@@ -50,7 +231,7 @@ String GetOptionalArgument(Script &State, String const &Name)
 	return State.GetString();
 }
 
-bool GetFlag(Script &State, String const &Name)
+bool GetFlag(QueryState &State, String const &Name)
 {
 	State.AssertTable("Arguments must be passed to this function in a table.  It appears that you passed in a " + State.GetType() + ".");
 	if (!State.TryElement(Name))
@@ -59,7 +240,7 @@ bool GetFlag(Script &State, String const &Name)
 	return State.GetBoolean();
 }
 
-void ClearArguments(Script &State)
+void ClearArguments(QueryState &State)
 {
 	assert(State.IsTable());
 	State.Pop();
@@ -74,6 +255,109 @@ void HelpItemCollector::Add(String const &Argument, String const &NewDescription
 
 namespace Information
 {
+	AnchorUses *Anchor::CurrentUses = nullptr;
+	Script *Anchor::CurrentScript = nullptr;
+
+	Anchor::Anchor(bool ChangesState, bool VariesBetweenRuns) : ChangesState(ChangesState), VariesBetweenRuns(VariesBetweenRuns), Generation(0), Latest(0), Replayed(false) {}
+
 	Anchor::~Anchor(void) {}
+
+	void Anchor::NoteUse(void)
+	{
+		DependencyScope::Note(Dependencies);
+		if (CurrentUses == nullptr) return;
+		if (Replayed) Restore();
+		for (auto &Use : *CurrentUses)
+			if (Use.first == this) return;
+		CurrentUses->push_back(std::make_pair(this, Generation));
+	}
+
+	bool Anchor::Recall(QueryState &State)
+	{
+		for (size_t Index = 0; Index < Memos.size(); ++Index)
+		{
+			Memo const &Candidate = Memos[Index];
+			if (!State.MatchArguments(Candidate.Arguments)) continue;
+			for (auto &Use : Candidate.Uses)
+				if (Use.first->Generation != Use.second) return false;
+			if (ChangesState && (Index != Latest)) return false;
+			Candidate.Result.Replay(State);
+			if (Verbose) StandardStream << "Reused the answer to an earlier identical Discover." << GetIdentifier() << " query.\n" << OutputStream::Flush();
+			Record(State, Candidate.Uses);
+			return true;
+		}
+		return false;
+	}
+
+	bool Anchor::Replay(QueryState &State)
+	{
+		if (VariesBetweenRuns) return false;
+		Response Result;
+		if (!LockResults.Find(GetIdentifier(), State, Result) && !RunResults.Find(GetIdentifier(), State, Result)) return false;
+		if (ChangesState)
+		{
+			// The item's state is still that of an earlier answer, so neither it nor the memos relying on it are any good until it's restored
+			++Generation;
+			Latest = Memos.size();
+			Replayed = true;
+			ReplayedArguments = State.CopyArguments();
+		}
+		Result.Replay(State);
+		return true;
+	}
+
+	void Anchor::Restore(void)
+	{
+		// The query the using item is answering wasn't recorded, or its recording is out of date, so it has to be discovered with the item as the recorded run left it
+		Replayed = false;
+		if (CurrentScript == nullptr) return;
+		if (Verbose) StandardStream << "Discovering the replayed Discover." << GetIdentifier() << " query again for a query that uses it.\n" << OutputStream::Flush();
+		unsigned int const Base = CurrentScript->Height();
+		QueryState Query(*CurrentScript, Base);
+		Query.PushArguments(ReplayedArguments);
+		AnchorUses Uses;
+		AnchorUses *OuterUses = CurrentUses;
+		CurrentUses = &Uses;
+		try
+		{
+			DependencyScope Scope(Dependencies);
+			Answer(Query);
+		}
+		catch (...)
+		{
+			CurrentUses = OuterUses;
+			throw;
+		}
+		CurrentUses = OuterUses;
+		while (CurrentScript->Height() > Base) CurrentScript->Pop();
+		++Generation;
+	}
+
+	void Anchor::Remember(QueryState const &State, AnchorUses const &Uses)
+	{
+		for (auto Existing = Memos.begin(); Existing != Memos.end(); ++Existing)
+			if (Existing->Arguments == State.GetArguments())
+			{
+				Memos.erase(Existing);
+				break;
+			}
+		Memos.push_back(Memo{State.GetArguments(), State.GetResponse(), Uses});
+		Latest = Memos.size() - 1;
+		Replayed = false;
+		Record(State, Uses);
+	}
+
+	void Anchor::Record(QueryState const &State, AnchorUses const &Uses)
+	{
+		if (VariesBetweenRuns) return;
+		std::vector<String> Stateful;
+		for (auto &Use : Uses)
+		{
+			if (Use.first->VariesBetweenRuns) return; // The answer may vary too
+			if (Use.first->ChangesState) Stateful.push_back(Use.first->GetIdentifier());
+		}
+		RunResults.Record(GetIdentifier(), State);
+		LockResults.Record(GetIdentifier(), State, Dependencies, Stateful);
+	}
 }
 
@@ -2,6 +2,8 @@
 #define INFORMATION_H
 
 #include <map>
+#include <set>
+#include <functional>
 
 #include "ren-general/string.h"
 #include "ren-general/inputoutput.h"
@@ -10,12 +12,91 @@
 #include "ren-script/script.h"
 
 #include "shared.h"
+#include "runcache.h"
 
-String GetArgument(Script &State, String const &Name); // Throws Error::Input if missing or empty
-std::vector<String> GetVariableArgument(Script &State, String const &Name);
-String GetOptionalArgument(Script &State, String const &Name); // Returns empty string if missing
-bool GetFlag(Script &State, String const &Name);
-void ClearArguments(Script &State);
+class QueryState;
+
+// The table an information item returned, as the operations that built it, so it can be stored and rebuilt
+struct Response
+{
+	enum struct Operations { Table, String, Integer, Boolean, Element, Index };
+	struct Step
+	{
+		Operations Operation;
+		String Text; // String values and element names
+		long Number; // Integer and boolean values and element indices
+	};
+	std::vector<Step> Steps;
+
+	void Replay(QueryState &State) const;
+};
+
+// An argument's value, kept so a query can be made again once the script's table is gone.  Tables are kept as lists, like GetVariableArgument reads them.
+struct ArgumentCopy
+{
+	String Type; // As from Script::GetType
+	String Text;
+	bool Flag;
+	unsigned int Number;
+	std::vector<ArgumentCopy> Elements;
+};
+typedef std::vector<std::pair<String, ArgumentCopy> > ArgumentCopies;
+
+// The script during one query.  Arguments the item reads are recorded with their values, and everything pushed for the result is recorded as a Response, so the query can be recognized and answered again later without the item.
+class QueryState
+{
+	public:
+		QueryState(Script &State, unsigned int Base = 0); // Base is the stack height below the query's arguments
+
+		void PushTable(void);
+		void PushString(String const &Value);
+		void PushInteger(long Value);
+		void PushBoolean(bool Value);
+		void PutElement(String const &Name);
+		void PutElement(unsigned int Index);
+
+		void PullElement(String const &Name);
+		bool TryElement(String const &Name);
+		void AssertTable(String const &Message);
+		void AssertString(String const &Message);
+		void AssertBoolean(String const &Message);
+		void AssertNumber(String const &Message);
+		bool IsTable(void);
+		bool IsString(void);
+		String GetType(void);
+		String GetString(void);
+		bool GetBoolean(void);
+		unsigned int GetUnsignedInteger(void);
+		void Iterate(std::function<bool(Script &State)> const &Callback);
+		void Pop(void);
+		unsigned int Height(void);
+
+		// True if every argument in Arguments has the described value, in which case they become this query's arguments as if they were read
+		bool MatchArguments(std::vector<std::pair<String, String> > const &Arguments);
+		std::vector<std::pair<String, String> > const &GetArguments(void) const; // Names and described values, in the order they were first read
+		ArgumentCopies CopyArguments(void); // The values of the arguments that were read; the table is left in place
+		void PushArguments(ArgumentCopies const &Arguments); // Pushes a table of copied arguments, to be the arguments of this query
+		Response const &GetResponse(void) const;
+
+	private:
+		// The argument Name in the table on top of the stack, in a form that compares equal for equal values; the table is left in place
+		String DescribeArgument(String const &Name);
+		void NoteArgument(String const &Name);
+		String DescribeValue(void);
+		ArgumentCopy CopyValue(void);
+		void PushValue(ArgumentCopy const &Value);
+
+		Script &State;
+		unsigned int const Base;
+		std::vector<std::pair<String, String> > Arguments;
+		Response Result;
+};
+
+String GetArgument(QueryState &State, String const &Name); // Throws Error::Input if missing or empty
+std::vector<String> GetVariableArgument(QueryState &State, String const &Name);
+String GetOptionalArgument(QueryState &State, String const &Name); // Returns empty string if missing
+bool GetFlag(QueryState &State, String const &Name);
+void ClearArguments(QueryState &State);
 
 class HelpItemCollector : public std::map<String, Set<String> >
 {
@@ -25,23 +106,75 @@ class HelpItemCollector : public std::map<String, Set<String> >
 
 namespace Information
 {
+	class Anchor;
+	typedef std::vector<std::pair<Anchor *, unsigned int> > AnchorUses; // Anchors used while answering a query, with their generations at the time
+
+	// Items whose queries change what they tell other items, like the compiler CXXCompiler gives Optimization, declare static bool const AnswersChangeState = true
+	template <typename ItemClass> class AnswersChangeState
+	{
+			template <typename Type> static constexpr bool Check(decltype(Type::AnswersChangeState) *) { return Type::AnswersChangeState; }
+			template <typename Type> static constexpr bool Check(...) { return false; }
+		public:
+			static bool const Value = Check<ItemClass>(nullptr);
+	};
+
+	// Items whose answers come from state that can't be fingerprinted and may differ between runs, like free memory, declare static bool const AnswersVaryBetweenRuns = true; they're never recorded or replayed
+	template <typename ItemClass> class AnswersVaryBetweenRuns
+	{
+			template <typename Type> static constexpr bool Check(decltype(Type::AnswersVaryBetweenRuns) *) { return Type::AnswersVaryBetweenRuns; }
+			template <typename Type> static constexpr bool Check(...) { return false; }
+		public:
+			static bool const Value = Check<ItemClass>(nullptr);
+	};
+
+	// A query answered earlier in this run, kept so a repeat of it is answered without the item
+	struct Memo
+	{
+		std::vector<std::pair<String, String> > Arguments; // As recorded by QueryState
+		Response Result;
+		AnchorUses Uses;
+	};
+
 	// By using anchors, the following is guaranteed (more or less);
 	// The item class is always instantiated before Respond is called or another information item needs it.
 	// The item class is only instantiated if Respond is called or if another information item needs it.
 	// -- Note, Respond may be called multiple times for different pieces of information.  Initialization should gather and cache all data that might be required multiple times.
+	// Repeated queries are answered from memos, unless an item the first answer relied on has since answered queries that change its state.
+	// Queries a lock or the run cache recorded are answered from the recording, and every other answer is given to them along with the files it depended on.
 	class Anchor
 	{
 		public:
+			Anchor(bool ChangesState, bool VariesBetweenRuns);
 			virtual ~Anchor(void);
 			virtual String GetIdentifier(void) = 0;
 			virtual void DisplayControllerHelp(void) = 0;
 			virtual Script::Function GetCallback(HelpItemCollector *HelpItems = nullptr) = 0;
+		protected:
+			void NoteUse(void); // Call whenever another item's query uses this item
+			bool Recall(QueryState &State); // Replays the memo for State's arguments if it's still good
+			bool Replay(QueryState &State); // Replays the answer the lock or run cache recorded, if any
+			virtual void Answer(QueryState &State) = 0; // Has the item respond to a query
+			void Remember(QueryState const &State, AnchorUses const &Uses); // Also gives the answer to the lock and run cache
+
+			bool const ChangesState, VariesBetweenRuns;
+			unsigned int Generation; // Counts the queries the item answered, if they change what it tells other items
+			std::set<String> Dependencies; // The files and directories making and answering with the item depended on
+			static AnchorUses *CurrentUses; // For the query an item is answering, if any
+			static Script *CurrentScript; // Likewise
+		private:
+			void Record(QueryState const &State, AnchorUses const &Uses);
+			void Restore(void); // Answers the latest replayed query again, so the item is in the state the recording assumed
+
+			std::vector<Memo> Memos;
+			size_t Latest; // The memo of the latest query the item answered itself; if it ChangesState, this is the only memo that leaves it as answering would
+			bool Replayed; // The latest query was answered from a recording, so if the item ChangesState, it isn't in the state the recorded run left it in
+			ArgumentCopies ReplayedArguments; // Of that query, to answer it again if another item needs the state
 	};
 
 	template <typename ItemClass> class AnchorImplementation : public Anchor
 	{
 		public:
-			AnchorImplementation(void) : AnchoredItem(nullptr) {}
+			AnchorImplementation(void) : Anchor(AnswersChangeState<ItemClass>::Value, AnswersVaryBetweenRuns<ItemClass>::Value), AnchoredItem(nullptr) {}
 			~AnchorImplementation(void) override { delete AnchoredItem; }
 			
 			String GetIdentifier(void) { return ItemClass::GetIdentifier(); }
@@ -53,10 +186,35 @@ namespace Information
 			{
 				return [&, HelpItems](Script State) -> int
 				{
-					if (AnchoredItem == nullptr) AnchoredItem = new ItemClass;
+					QueryState Query(State);
 					try 
 					{
-						AnchoredItem->Respond(State, HelpItems);
+						// Help mode has to reach every item so the override help is collected
+						bool const Answer = HelpItems != nullptr;
+						if (Answer || (!Recall(Query) && !Replay(Query)))
+						{
+							Construct();
+							AnchorUses Uses;
+							AnchorUses *OuterUses = CurrentUses;
+							Script *OuterScript = CurrentScript;
+							CurrentUses = &Uses;
+							CurrentScript = &State;
+							try
+							{
+								DependencyScope Scope(Dependencies);
+								AnchoredItem->Respond(Query, HelpItems);
+							}
+							catch (...)
+							{
+								CurrentUses = OuterUses;
+								CurrentScript = OuterScript;
+								throw;
+							}
+							CurrentUses = OuterUses;
+							CurrentScript = OuterScript;
+							if (ChangesState) ++Generation;
+							if (HelpItems == nullptr) Remember(Query, Uses);
+						}
 						assert(State.IsTable());
 						if (State.IsEmpty())
 						{
@@ -89,10 +247,20 @@ namespace Information
 			
 			ItemClass *operator->(void)
 			{
-				if (AnchoredItem == nullptr) AnchoredItem = new ItemClass;
+				Construct();
+				NoteUse();
 				return AnchoredItem;
 			}
+		protected:
+			void Answer(QueryState &State) override { AnchoredItem->Respond(State, nullptr); }
 		private:
+			void Construct(void)
+			{
+				if (AnchoredItem != nullptr) return;
+				DependencyScope Scope(Dependencies);
+				AnchoredItem = new ItemClass;
+			}
+
 			ItemClass *AnchoredItem;
 	};
 }
@@ -0,0 +1,237 @@
+#include "allocator.h"
+
+#include <fstream>
+#include <cstdlib>
+
+#include "../shared.h"
+#include "../configuration.h"
+#include "../runcache.h"
+#include "clibrary.h"
+
+extern Information::AnchorImplementation<CLibrary> CLibraryInformation;
+extern bool Verbose;
+
+struct AllocatorKind
+{
+	String const Name;
+	std::vector<String> const LibraryNames; // Library and pkg-config names
+	String const Header;
+};
+
+// In order of preference
+static std::vector<AllocatorKind> const AllocatorKinds
+{
+	{"jemalloc", {"jemalloc"}, "jemalloc/jemalloc.h"},
+	{"tcmalloc_minimal", {"tcmalloc_minimal", "libtcmalloc_minimal"}, "gperftools/tcmalloc.h"},
+	{"tcmalloc", {"tcmalloc", "libtcmalloc"}, "gperftools/tcmalloc.h"},
+	{"mimalloc", {"mimalloc"}, "mimalloc.h"}
+};
+
+// Keeps compilers from optimizing around allocation calls in ways that assume the C library's allocator
+static std::vector<String> const AllocatorFlags{"-fno-builtin-malloc", "-fno-builtin-calloc", "-fno-builtin-realloc", "-fno-builtin-free"};
+
+// Object-like macros defined in the first copy of Header found in IncludeDirectories, with surrounding quotes removed from values
+static std::map<String, String> ReadDefines(std::vector<String> const &IncludeDirectories, String const &Header)
+{
+	std::map<String, String> Out;
+	for (auto &Directory : IncludeDirectories)
+	{
+		RecordDependency(Directory + "/" + Header);
+		std::ifstream Input((Directory + "/" + Header).c_str());
+		if (!Input) continue;
+		String Line;
+		while (std::getline(Input, Line))
+		{
+			size_t Position = Line.find_first_not_of(" \t");
+			if ((Position == String::npos) || (Line[Position] != '#')) continue;
+			Position = Line.find_first_not_of(" \t", Position + 1);
+			if ((Position == String::npos) || (Line.compare(Position, 7, "define ") != 0)) continue;
+			size_t const NameStart = Line.find_first_not_of(" \t", Position + 7);
+			if (NameStart == String::npos) continue;
+			size_t const NameEnd = Line.find_first_of(" \t(", NameStart);
+			if ((NameEnd == String::npos) || (Line[NameEnd] == '(')) continue;
+			size_t const ValueStart = Line.find_first_not_of(" \t", NameEnd);
+			if (ValueStart == String::npos) continue;
+			size_t const ValueEnd = Line.find_last_not_of(" \t\r") + 1;
+			String Value = Line.substr(ValueStart, ValueEnd - ValueStart);
+			if ((Value.length() >= 2) && (Value.front() == '"') && (Value.back() == '"')) Value = Value.substr(1, Value.length() - 2);
+			Out.insert(std::make_pair(Line.substr(NameStart, NameEnd - NameStart), Value));
+		}
+		break;
+	}
+	return Out;
+}
+
+String Allocator::GetIdentifier(void) { return "Allocator"; }
+
+void Allocator::DisplayControllerHelp(void)
+{
+	MemoryStream Names;
+	for (auto &Kind : AllocatorKinds) Names << (&Kind == &AllocatorKinds.front() ? "" : ", ") << Kind.Name;
+	StandardStream << "\tDiscover." << GetIdentifier() << "{Static = STATIC}\n"
+		"\tResult: {Name = NAME, Filenames = {FILENAME...}, LibraryDirectories = {LIBRARYDIR...}, IncludeDirectories = {INCLUDEDIR...}, Flags = {FLAG...}, Allocators = {{Name = NAME, Version = VERSION, SymbolPrefix = PREFIX, Shared = LIBRARY, Static = LIBRARY}...}}\n"
+		"\tFinds the installed high-performance memory allocators, using the same search as Discover.CLibrary.  NAME is one of: " << (String)Names << ", in order of preference.  The preferred allocator is the first one found that replaces malloc (with an empty PREFIX) and is available as a static library if STATIC is true, or a shared library otherwise.  Its FILENAMEs, LIBRARYDIRs, and INCLUDEDIRs are as in Discover.CLibrary, and FLAGs should be used when compiling code that will be linked with it.  If no allocator can be used, Name and the fields after it up to Allocators are missing.\n"
+		"\tAllocators lists every allocator found.  VERSION comes from the allocator's header and is missing if the header doesn't say.  PREFIX is the prefix of the allocator's malloc and related functions, which is empty if they replace the C library's.  Each LIBRARY is {Filenames = {FILENAME...}, LibraryDirectories = {LIBRARYDIR...}, IncludeDirectories = {INCLUDEDIR...}} and is missing if that kind of library wasn't found.\n"
+		"\n";
+}
+
+void Allocator::Respond(QueryState &State, HelpItemCollector *HelpItems)
+{
+	bool const PreferStatic = GetFlag(State, "Static");
+	ClearArguments(State);
+
+	if (HelpItems != nullptr)
+		HelpItems->Add(GetIdentifier() + "=NAME", "Overrides the preferred allocator.  NAME is the name of an allocator that was found, or None to use the C library's allocator.");
+	std::pair<bool, String> OverrideAllocator = FindConfiguration(GetIdentifier());
+
+	struct Candidate
+	{
+		AllocatorKind const &Kind;
+		String Version;
+		String SymbolPrefix;
+		bool HasShared, HasStatic;
+		CLibrary::Library Shared, Static;
+	};
+	std::vector<Candidate> Candidates;
+	for (auto &Kind : AllocatorKinds)
+	{
+		Candidates.push_back(Candidate{Kind, String(), String(), false, false, CLibrary::Library(), CLibrary::Library()});
+		Candidate &Current = Candidates.back();
+		Current.HasShared = CLibraryInformation->Find(Kind.LibraryNames, false, Kind.Header, Current.Shared, HelpItems);
+		Current.HasStatic = CLibraryInformation->Find(Kind.LibraryNames, true, Kind.Header, Current.Static, HelpItems);
+		if (!Current.HasShared && !Current.HasStatic)
+		{
+			if (Verbose) StandardStream << "Allocator " << Kind.Name << " wasn't found.\n" << OutputStream::Flush();
+			Candidates.pop_back();
+			continue;
+		}
+
+		std::map<String, String> const Defines = ReadDefines((Current.HasShared ? Current.Shared : Current.Static).IncludeDirectories, Kind.Header);
+		auto Find = [&](String const &Name) { auto Found = Defines.find(Name); return (Found == Defines.end()) ? String() : Found->second; };
+		if (Kind.Name == "jemalloc")
+		{
+			// Like "5.3.0-0-g54eaed1d8b56b1aa528be3bdd1877e59c56fa90c"
+			Current.Version = Find("JEMALLOC_VERSION");
+			Current.Version = Current.Version.substr(0, Current.Version.find('-'));
+			// The header maps its public names to the exported ones, like "#define je_malloc malloc" when built without a prefix
+			String const Exported = Find("je_malloc");
+			if ((Exported.length() > 6) && (Exported.compare(Exported.length() - 6, 6, "malloc") == 0))
+				Current.SymbolPrefix = Exported.substr(0, Exported.length() - 6);
+		}
+		else if (Kind.Header == "gperftools/tcmalloc.h")
+		{
+			// Like "gperftools 2.10"
+			Current.Version = Find("TC_VERSION_STRING");
+			size_t const Space = Current.Version.rfind(' ');
+			if (Space != String::npos) Current.Version = Current.Version.substr(Space + 1);
+		}
+		else if (Kind.Name == "mimalloc")
+		{
+			// Like 212 for 2.1.2
+			String const Encoded = Find("MI_MALLOC_VERSION");
+			if (!Encoded.empty())
+			{
+				unsigned long const Number = strtoul(Encoded.c_str(), nullptr, 10);
+				Current.Version = MemoryStream() << (Number / 100) << "." << ((Number / 10) % 10) << "." << (Number % 10);
+			}
+		}
+		if (Verbose)
+			StandardStream << "Found allocator " << Kind.Name << (Current.Version.empty() ? String() : " " + Current.Version) <<
+				(Current.HasShared ? ", shared" : "") << (Current.HasStatic ? ", static" : "") <<
+				(Current.SymbolPrefix.empty() ? String() : ", with symbol prefix " + Current.SymbolPrefix) << ".\n" << OutputStream::Flush();
+	}
+
+	Candidate const *Chosen = nullptr;
+	if (OverrideAllocator.first)
+	{
+		if (Verbose) StandardStream << "Using allocator \"" << OverrideAllocator.second << "\" specified by configuration.\n" << OutputStream::Flush();
+		if (OverrideAllocator.second != "None")
+		{
+			for (auto &Current : Candidates)
+				if (Current.Kind.Name == OverrideAllocator.second) Chosen = &Current;
+			if ((Chosen == nullptr) || !(PreferStatic ? Chosen->HasStatic : Chosen->HasShared))
+				throw InteractionError("Allocator \"" + OverrideAllocator.second + "\" was specified by configuration but wasn't found" + (PreferStatic ? " as a static library." : " as a shared library."));
+		}
+	}
+	else
+	{
+		for (auto &Current : Candidates)
+			if (Current.SymbolPrefix.empty() && (PreferStatic ? Current.HasStatic : Current.HasShared))
+			{
+				Chosen = &Current;
+				break;
+			}
+	}
+
+	auto PushLibrary = [&](CLibrary::Library const &Library)
+	{
+		State.PushTable();
+		for (unsigned int Index = 1; Index <= Library.Filenames.size(); ++Index)
+		{
+			State.PushString(Library.Filenames[Index - 1]);
+			State.PutElement(Index);
+		}
+		State.PutElement("Filenames");
+		State.PushTable();
+		for (unsigned int Index = 1; Index <= Library.LibraryDirectories.size(); ++Index)
+		{
+			State.PushString(Library.LibraryDirectories[Index - 1]);
+			State.PutElement(Index);
+		}
+		State.PutElement("LibraryDirectories");
+		State.PushTable();
+		for (unsigned int Index = 1; Index <= Library.IncludeDirectories.size(); ++Index)
+		{
+			State.PushString(Library.IncludeDirectories[Index - 1]);
+			State.PutElement(Index);
+		}
+		State.PutElement("IncludeDirectories");
+	};
+
+	State.PushTable();
+	if (Chosen != nullptr)
+	{
+		if (Verbose) StandardStream << "Chose allocator " << Chosen->Kind.Name << ".\n" << OutputStream::Flush();
+		State.PushString(Chosen->Kind.Name);
+		State.PutElement("Name");
+		PushLibrary(PreferStatic ? Chosen->Static : Chosen->Shared);
+		State.PushTable();
+		for (unsigned int Index = 1; Index <= AllocatorFlags.size(); ++Index)
+		{
+			State.PushString(AllocatorFlags[Index - 1]);
+			State.PutElement(Index);
+		}
+		State.PutElement("Flags");
+	}
+
+	State.PushTable();
+	for (unsigned int Index = 1; Index <= Candidates.size(); ++Index)
+	{
+		Candidate const &Current = Candidates[Index - 1];
+		State.PushTable();
+		State.PushString(Current.Kind.Name);
+		State.PutElement("Name");
+		if (!Current.Version.empty())
+		{
+			State.PushString(Current.Version);
+			State.PutElement("Version");
+		}
+		State.PushString(Current.SymbolPrefix);
+		State.PutElement("SymbolPrefix");
+		if (Current.HasShared)
+		{
+			State.PushTable();
+			PushLibrary(Current.Shared);
+			State.PutElement("Shared");
+		}
+		if (Current.HasStatic)
+		{
+			State.PushTable();
+			PushLibrary(Current.Static);
+			State.PutElement("Static");
+		}
+		State.PutElement(Index);
+	}
+	State.PutElement("Allocators");
+}
+
@@ -0,0 +1,14 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include "../information.h"
+
+class Allocator
+{
+	public:
+		static String GetIdentifier(void);
+		static void DisplayControllerHelp(void);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+};
+
+#endif // ALLOCATOR_H
@@ -1,8 +1,12 @@
 #include "clibrary.h"
 
+#include <tuple>
+
 #include "../shared.h"
 #include "../configuration.h"
 #include "../subprocess.h"
+#include "../directoryindex.h"
+#include "../filesystemprobe.h"
 #include "platform.h"
 #include "program.h"
 
@@ -14,11 +18,11 @@ String CLibrary::GetIdentifier(void) { return "CLibrary"; }
 
 void CLibrary::DisplayControllerHelp()
 {
-	StandardStream << "\tDiscover." << GetIdentifier() << "{Name = NAME | {NAME...}, FLAGS...}\n"
+	StandardStream << "\tDiscover." << GetIdentifier() << "{Name = NAME | {NAME...}, Header = HEADER, FLAGS...}\n"
 		"\tReturns: {Filenames = {FILENAME...}, LibraryDirectories = {LIBRARYDIR...}, IncludeDirectories = {INCLUDEDIR...} }\n"
-		"\tLocates and returns information about C library NAME.  If NAME is plural, the values of NAME will be searched for in order until one is found.\n"
+		"\tLocates and returns information about C library NAME.  If NAME is plural, the values of NAME will be searched for in order until one is found.  If HEADER is specified (a path relative to the include directory, like zlib.h or gtk/gtk.h), libraries found without HEADER in their include directory are passed over.\n"
 		"\tFLAGS can be any number of the following boolean flags: Optional, Static.  If Optional is not specified, the configuration will abort if the library is not found.  If Optional is specified and the library is not found, no response will be returned.  If Static is specified, a static library will be located instead of a dynamic library.\n"
-		"\tFILENAME is the filename of the library, multiple names if the library has multiple files.  If pkg-config is used to locate the library, FILENAME might be a ld-style library namespec.  INCLUDEDIR will contain the location of headers associated with the library.  LIBRARYDIR will contain the location of the library itself.  NAME, LIBRARYDIR, and INCLUDEDIR will generally be singular and LIBRARYDIR will contain the file specified by NAME, except when using pkg-config.\n"
+		"\tFILENAME is the filename of the library, multiple names if the library has multiple files.  If the library is located through its pkg-config file, FILENAME might be a ld-style library namespec.  INCLUDEDIR will contain the location of headers associated with the library.  LIBRARYDIR will contain the location of the library itself.  NAME, LIBRARYDIR, and INCLUDEDIR will generally be singular and LIBRARYDIR will contain the file specified by NAME, except when using pkg-config.\n"
 		"\n";
 }
 
@@ -40,7 +44,8 @@ static std::vector<DirectoryPath> SplitEnvironmentVariableParts(String const &Ra
 	return std::move(Out);
 }
 
-static std::vector<DirectoryPath> GatherTestLocations(void)
+// EnvironmentCount is set to the number of leading locations that came from LD_LIBRARY*_PATH variables
+static std::vector<DirectoryPath> GatherTestLocations(size_t &EnvironmentCount)
 {
 	std::vector<DirectoryPath> TestLocations;
 
@@ -66,12 +71,13 @@ static std::vector<DirectoryPath> GatherTestLocations(void)
 	}
 
 	// Try LD_LIBRARY_PATH values
-	char const *LD32Path = getenv("LD_LIBRARY32_PATH");
-	if (LD32Path != nullptr)
+	char const *LDPath = getenv("LD_LIBRARY_PATH");
+	if (LDPath != nullptr)
 	{
-		auto NewParts = SplitEnvironmentVariableParts(LD32Path);
+		auto NewParts = SplitEnvironmentVariableParts(LDPath);
 		TestLocations.insert(TestLocations.end(), NewParts.begin(), NewParts.end());
 	}
+	EnvironmentCount = TestLocations.size();
 
 	// Try system directories
 #ifdef _WIN32
@@ -109,24 +115,79 @@ static std::vector<DirectoryPath> GatherTestLocations(void)
 	return std::move(TestLocations);
 }
 
-CLibrary::CLibrary(void) : TestLocations(GatherTestLocations()) 
+CLibrary::CLibrary(void) : EnvironmentLocations(0), LoaderCache(FilePath::Qualify("/etc/ld.so.cache"), PlatformInformation->GetArchitectureBits())
 {
+	// Each directory is listed once here so that every candidate filename can be checked without touching the filesystem
+	for (auto &Location : GatherTestLocations(EnvironmentLocations))
+		TestLocations.emplace_back(Location);
 	if (Verbose)
 	{
 		StandardStream << "Checking the following directories for libraries:\n";
 		for (auto &Location : TestLocations)
-			StandardStream << "\t" << Location << "\n";
+			StandardStream << "\t" << Location.GetDirectory() << "\n";
 		StandardStream << OutputStream::Flush();
 	}
 }
 
-void CLibrary::Respond(Script &State, HelpItemCollector *HelpItems)
+DirectoryIndex &CLibrary::GetListing(DirectoryPath const &Directory)
 {
-	std::vector<String> LibraryNames = GetVariableArgument(State, "Name");
-	bool RequireStatic = GetFlag(State, "Static");
-	bool Optional = GetFlag(State, "Optional");
-	ClearArguments(State);
+	String const Key = Directory.AsAbsoluteString();
+	auto Found = Listings.find(Key);
+	if (Found == Listings.end())
+		Found = Listings.emplace(std::piecewise_construct, std::forward_as_tuple(Key), std::forward_as_tuple(Directory)).first;
+	return Found->second;
+}
 
+String CLibrary::FindIncludeRoot(DirectoryPath const &Directory)
+{
+	// Gather the directories up to the root (or to one already answered) and check for all of their include siblings at once
+	std::vector<std::pair<String, String> > Chain; // A directory and the include directory beside it
+	String Result;
+	DirectoryPath Current = Directory;
+	while (true)
+	{
+		String const Key = Current.AsAbsoluteString();
+		auto Found = IncludeRoots.find(Key);
+		if (Found != IncludeRoots.end())
+		{
+			Result = Found->second;
+			break;
+		}
+		if (Current.IsRoot())
+		{
+			IncludeRoots[Key] = String();
+			break;
+		}
+		DirectoryPath const Parent = Current.Exit();
+		Chain.push_back(std::make_pair(Key, String(Parent.Enter("include"))));
+		Current = Parent;
+	}
+
+	std::vector<String> Candidates;
+	for (auto &Link : Chain) Candidates.push_back(Link.second);
+	std::vector<PathStatus> const Statuses = ProbePaths(Candidates);
+	for (size_t Index = Chain.size(); Index-- > 0; )
+	{
+		if (Statuses[Index].IsDirectory) Result = Chain[Index].second;
+		IncludeRoots[Chain[Index].first] = Result;
+	}
+	return Result;
+}
+
+bool CLibrary::HasHeader(DirectoryPath const &IncludeRoot, String const &Header)
+{
+	DirectoryPath Directory = IncludeRoot;
+	std::queue<String> Parts = StringSplitter({'/'}, true).Process(Header).Results();
+	while (Parts.size() > 1)
+	{
+		Directory = Directory.Enter(Parts.front());
+		Parts.pop();
+	}
+	return !Parts.empty() && GetListing(Directory).Contains(Parts.front());
+}
+
+bool CLibrary::Find(std::vector<String> const &LibraryNames, bool Static, String const &Header, Library &Out, HelpItemCollector *HelpItems)
+{
 	String const LibraryName = LibraryNames[0];
 	
 	if (HelpItems != nullptr)
@@ -136,36 +197,37 @@ void CLibrary::Respond(Script &State, HelpItemCollector *HelpItems)
 		HelpItems->Add(GetIdentifier() + "-" + LibraryName + "-Includes=LOCATION", "Overrides the location of include files for library " + LibraryName + ".  LOCATION can also be a comma separated list of locations.");
 	}
 
+	if (HelpItems != nullptr)
+		HelpItems->Add("CLibraryExternalPkgConfig", "Runs pkg-config for libraries that can't be found otherwise, after searching the pkg-config files directly.");
+	bool const UseExternalPkgConfig = FindConfiguration("CLibraryExternalPkgConfig").first;
+
 	std::pair<bool, String> OverrideLibrary = FindConfiguration(GetIdentifier() + "-" + LibraryName),
 		OverrideIncludes = FindConfiguration(GetIdentifier() + "-" + LibraryName + "-Includes");
 
 	if (Verbose && !OverrideLibrary.first) StandardStream << "Override location for library \"" << LibraryName << "\" not specified with flag \"" << GetIdentifier() + "-" + LibraryName << "\"; proceeding with normal discovery." << "\n" << OutputStream::Flush();
 
-	// Results
 	bool Found = false;
-	std::vector<String> LibraryFilenames;
-	std::vector<String> LibraryLocations;
-	std::vector<String> IncludeLocations;
 
 	auto AddLibraryFilename = [&](String const Filename)
 	{
 		Found = true;
-		LibraryFilenames.push_back(Filename);
+		Out.Filenames.push_back(Filename);
 	};
 	
 	auto AddLibraryLocation = [&](String const Location)
 	{
 		Found = true;
-		LibraryLocations.push_back(Location);
+		Out.LibraryDirectories.push_back(Location);
 	};
 	
 	auto AddIncludeLocation = [&](String const Location)
 	{
 		Found = true;
-		IncludeLocations.push_back(Location);
+		Out.IncludeDirectories.push_back(Location);
 	};
 
-	auto FindIncludeLocation = [&](FilePath const &LibraryPath)
+	// Returns false if HEADER was requested but isn't in any include directory near the library
+	auto FindIncludeLocation = [&](FilePath const &LibraryPath) -> bool
 	{
 		if (OverrideIncludes.first) 
 		{
@@ -176,22 +238,23 @@ void CLibrary::Respond(Script &State, HelpItemCollector *HelpItems)
 				AddIncludeLocation(OverrideSplits.Results().front());
 				OverrideSplits.Results().pop();
 			}
+			return true;
 		}
-		else 
+
+		String IncludeRoot = FindIncludeRoot(LibraryPath.Directory());
+		if (!Header.empty())
 		{
-			DirectoryPath ResultPath = LibraryPath.Directory();
-			DirectoryPath IncludeSearchPath = ResultPath;
-			while (!IncludeSearchPath.IsRoot())
+			while (!IncludeRoot.empty() && !HasHeader(DirectoryPath::Qualify(IncludeRoot), Header))
+				IncludeRoot = FindIncludeRoot(DirectoryPath::Qualify(IncludeRoot).Exit());
+			if (IncludeRoot.empty())
 			{
-				IncludeSearchPath = IncludeSearchPath.Exit();
-				if (IncludeSearchPath.Select("include").Exists())
-				{
-					ResultPath = IncludeSearchPath.Enter("include");
-					break;
-				}
+				if (Verbose) StandardStream << "No include directory above \"" << LibraryPath << "\" contains header \"" << Header << "\"\n" << OutputStream::Flush();
+				return false;
 			}
-			AddIncludeLocation(ResultPath);
 		}
+		if (IncludeRoot.empty()) AddIncludeLocation(LibraryPath.Directory());
+		else AddIncludeLocation(IncludeRoot);
+		return true;
 	};
 
 	if (OverrideLibrary.first)
@@ -203,9 +266,10 @@ void CLibrary::Respond(Script &State, HelpItemCollector *HelpItems)
 			if (Verbose) StandardStream << "Testing for library \"" << LibraryName << "\" at \"" << OverrideLibraryPath << "\"\n" << OutputStream::Flush();
 			if (!OverrideLibraryPath.Exists())
 				throw InteractionError("The location of library \"" + LibraryName + "\" was manually specified but the file does not exist at that location.");
+			if (!FindIncludeLocation(OverrideLibraryPath))
+				throw InteractionError("The location of library \"" + LibraryName + "\" was manually specified but header \"" + Header + "\" wasn't found in an include directory near it.  Specify the include location with \"" + GetIdentifier() + "-" + LibraryName + "-Includes\".");
 			AddLibraryFilename(OverrideLibraryPath.File());
 			AddLibraryLocation(OverrideLibraryPath.Directory());
-			FindIncludeLocation(OverrideLibraryPath);
 		}
 		catch (Error::Construction &Failure)
 		{
@@ -213,59 +277,147 @@ void CLibrary::Respond(Script &State, HelpItemCollector *HelpItems)
 		}
 	}
 	
-	if (!Found)
+	// Do a brute force search of the locations from Begin to End, checking every candidate the listings can't rule out in one batch
+	auto SearchLocations = [&](size_t Begin, size_t End)
 	{
-		// Do a brute force search
-		auto ProcessLibraryLocation = [&](FilePath const &Location) -> bool
+		std::vector<std::pair<DirectoryIndex *, String> > Candidates;
+		for (auto &TestName : LibraryNames)
 		{
+			std::vector<String> Filenames{TestName};
+			if (PlatformInformation->GetFamily() == Platform::Families::Windows)
+			{
+				if (Static) Filenames.insert(Filenames.end(), {TestName + ".lib", "lib" + TestName + ".lib"});
+				else Filenames.insert(Filenames.end(), {TestName + ".dll", "lib" + TestName + ".dll"});
+			}
+			else
+			{
+				if (Static) Filenames.insert(Filenames.end(), {"lib" + TestName + ".a", TestName + ".a"});
+				else Filenames.insert(Filenames.end(), {"lib" + TestName + ".so", TestName + ".so"});
+			}
+			for (size_t Location = Begin; Location < End; ++Location)
+				for (auto &Filename : Filenames)
+					if (TestLocations[Location].Check(Filename) != DirectoryIndex::Answers::No)
+						Candidates.push_back(std::make_pair(&TestLocations[Location], Filename));
+		}
+
+		std::vector<size_t> Unconfirmed;
+		std::vector<String> UnconfirmedPaths;
+		for (size_t Index = 0; Index < Candidates.size(); ++Index)
+		{
+			if (Candidates[Index].first->Check(Candidates[Index].second) != DirectoryIndex::Answers::Unknown) continue;
+			Unconfirmed.push_back(Index);
+			UnconfirmedPaths.push_back(Candidates[Index].first->GetDirectory().Select(Candidates[Index].second).AsAbsoluteString());
+		}
+		std::vector<PathStatus> const Statuses = ProbePaths(UnconfirmedPaths);
+		for (size_t Index = 0; Index < Unconfirmed.size(); ++Index)
+		{
+			auto &Candidate = Candidates[Unconfirmed[Index]];
+			Candidate.first->Confirm(Candidate.second, Statuses[Index].Exists);
+		}
+
+		for (auto &Candidate : Candidates)
+		{
+			FilePath const Location = Candidate.first->GetDirectory().Select(Candidate.second);
 			if (Verbose) StandardStream << "Testing for library \"" << LibraryName << "\" at \"" << Location << "\"\n" << OutputStream::Flush();
-			if (!Location.Exists()) return false;
+			if (!Candidate.first->Contains(Candidate.second)) continue;
+			if (!FindIncludeLocation(Location)) continue;
 			AddLibraryFilename(Location.File());
 			AddLibraryLocation(Location.Directory());
-			FindIncludeLocation(Location);
-			return true;
-		};
+			break;
+		}
+	};
+
+	// LD_LIBRARY*_PATH directories come first, since they're set to take precedence over the system's libraries
+	if (!Found) SearchLocations(0, EnvironmentLocations);
 
+	if (!Found && !Static && LoaderCache.IsLoaded())
+	{
+		// Ask the dynamic linker's cache, which knows every library the loader would find
 		for (auto &TestName : LibraryNames)
 		{
-			for (auto &TestLocation : TestLocations)
+			std::vector<String> const Candidates = LoaderCache.Find(TestName);
+			if (Verbose) StandardStream << "Loader cache has " << Candidates.size() << " entries for library \"" << TestName << "\"\n" << OutputStream::Flush();
+			if (Candidates.empty()) continue;
+			// The cache lists sonames, but linking needs the unversioned development name, so runtime-only installs are passed over
+			FilePath const Location = FilePath::Qualify(Candidates[0]).Directory().Select("lib" + TestName + ".so");
+			if (!Location.Exists())
 			{
-				if (ProcessLibraryLocation(TestLocation.Select(TestName))) break;
-
-				if (PlatformInformation->GetFamily() == Platform::Families::Windows)
-				{
-					if (RequireStatic)
-					{ 
-						if (ProcessLibraryLocation(TestLocation.Select(TestName + ".lib"))) break; 
-						if (ProcessLibraryLocation(TestLocation.Select("lib" + TestName + ".lib"))) break; 
-					}
-					else
-					{
-						if (ProcessLibraryLocation(TestLocation.Select(TestName + ".dll"))) break;
-						if (ProcessLibraryLocation(TestLocation.Select("lib" + TestName + ".dll"))) break;
-					}
-				}
-				else
-				{
-					if (RequireStatic)
-					{
-						if (ProcessLibraryLocation(TestLocation.Select("lib" + TestName + ".a"))) break;
-						if (ProcessLibraryLocation(TestLocation.Select(TestName + ".a"))) break;
-					}
-					else
-					{
-						if (ProcessLibraryLocation(TestLocation.Select("lib" + TestName + ".so"))) break;
-						if (ProcessLibraryLocation(TestLocation.Select(TestName + ".so"))) break;
-					}
-				}
+				if (Verbose) StandardStream << "Library \"" << TestName << "\" is in the loader cache but \"" << Location << "\" isn't installed\n" << OutputStream::Flush();
+				continue;
 			}
-			if (Found) break;
+			if (!FindIncludeLocation(Location)) continue;
+			AddLibraryFilename(Location.File());
+			AddLibraryLocation(Location.Directory());
+			break;
 		}
 	}
 
+	if (!Found) SearchLocations(EnvironmentLocations, TestLocations.size());
+
+	// Packages list directories and namespecs without checking them, so the package's own library has to exist in the requested kind, and HEADER has to be in one of its include directories or near that library
+	auto AddPackage = [&](String const &TestName, PackageConfig::Result const &Package) -> bool
+	{
+		if (Package.Libraries.empty())
+		{
+			if (Verbose) StandardStream << "Package \"" << TestName << "\" names no libraries\n" << OutputStream::Flush();
+			return false;
+		}
+		String const &Namespec = Package.Libraries.front();
+		String Filename;
+		if (Namespec[0] == ':') Filename = Namespec.substr(1);
+		else if (PlatformInformation->GetFamily() == Platform::Families::Windows) Filename = Namespec + (Static ? ".lib" : ".dll");
+		else Filename = "lib" + Namespec + (Static ? ".a" : ".so");
+
+		// The linker looks in the package's directories, then the system's
+		std::vector<FilePath> Locations;
+		for (auto &Location : Package.LibraryDirectories) Locations.push_back(DirectoryPath::Qualify(Location).Select(Filename));
+		for (auto &Location : TestLocations) Locations.push_back(Location.GetDirectory().Select(Filename));
+		std::vector<String> Paths;
+		for (auto &Location : Locations) Paths.push_back(Location.AsAbsoluteString());
+		int const Index = FindFirstPath(Paths, [](String const &, PathStatus const &Status) { return Status.Exists; });
+		if (Index == -1)
+		{
+			if (Verbose) StandardStream << "Package \"" << TestName << "\" names library \"" << Filename << "\" but it isn't installed\n" << OutputStream::Flush();
+			return false;
+		}
+		FilePath const &Library = Locations[Index];
+
+		if (!Header.empty() && !OverrideIncludes.first)
+		{
+			bool HeaderFound = false;
+			for (auto &Location : Package.IncludeDirectories)
+				if ((HeaderFound = HasHeader(DirectoryPath::Qualify(Location), Header))) break;
+			// System include directories are left out of packages, so look above the library like the other searches do
+			for (String IncludeRoot = FindIncludeRoot(Library.Directory()); !HeaderFound && !IncludeRoot.empty(); IncludeRoot = FindIncludeRoot(DirectoryPath::Qualify(IncludeRoot).Exit()))
+				HeaderFound = HasHeader(DirectoryPath::Qualify(IncludeRoot), Header);
+			if (!HeaderFound)
+			{
+				if (Verbose) StandardStream << "Package \"" << TestName << "\" doesn't provide header \"" << Header << "\"\n" << OutputStream::Flush();
+				return false;
+			}
+		}
+
+		if (OverrideIncludes.first) FindIncludeLocation(Library);
+		else for (auto &Location : Package.IncludeDirectories) AddIncludeLocation(Location);
+		for (auto &Location : Package.LibraryDirectories) AddLibraryLocation(Location);
+		for (auto &Filename : Package.Libraries) AddLibraryFilename(Filename);
+		return true;
+	};
+
 	if (!Found)
 	{
-		// Try pkg-config, because GTK has (multiple) inconsistently named binaries
+		// Try pkg-config packages, because GTK has (multiple) inconsistently named binaries
+		for (auto &TestName : LibraryNames)
+		{
+			PackageConfig::Result Package;
+			if (!Packages.Resolve(TestName, Static, Package)) continue;
+			if (AddPackage(TestName, Package)) break;
+		}
+	}
+
+	if (!Found && UseExternalPkgConfig)
+	{
+		// Ask pkg-config itself, for setups (personalities, pkgconf extensions) the built-in reader doesn't follow
 		FilePath *PkgConfigPath = ProgramInformation->FindProgram("pkg-config");
 #ifdef WINDOWS
 		if (PkgConfigPath == nullptr) PkgConfigPath = ProgramInformation->FindProgram("pkg-config.exe");
@@ -273,38 +425,42 @@ void CLibrary::Respond(Script &State, HelpItemCollector *HelpItems)
 #endif
 		if (PkgConfigPath != nullptr)
 		{
+			// Query every candidate name at once, then take the first that pkg-config knows in name order
+			SubprocessGroup Queries;
+			std::vector<std::pair<Subprocess *, Subprocess *> > Finders;
 			for (auto &TestName : LibraryNames)
+				Finders.push_back(std::make_pair(
+					&Queries.Start(PkgConfigPath->AsAbsoluteString(), {"--cflags", TestName}),
+					&Queries.Start(PkgConfigPath->AsAbsoluteString(), {"--libs", TestName})));
+			Queries.WaitAll();
+
+			for (auto &Finder : Finders)
 			{
-				Subprocess IncludeFinder(PkgConfigPath->AsAbsoluteString(), {"--cflags", TestName});
-				StringSplitter IncludeSplits({' '}, true);
-				while (!IncludeFinder.Out.HasFailed())
-				{
-					String Line = IncludeFinder.Out.ReadLine();
-					IncludeSplits.Process(Line);
-					if (Verbose)
-						StandardStream << "Include pkg-config output: " << Line << "\n" << OutputStream::Flush();
-				}
+				Subprocess &IncludeFinder = *Finder.first;
+				String const IncludeOutput = IncludeFinder.Out.ReadAll();
+				if (Verbose)
+					StandardStream << "Include pkg-config output: " << IncludeOutput << IncludeFinder.Error.ReadAll() << "\n" << OutputStream::Flush();
+				StringSplitter IncludeSplits({' ', '\n'}, true);
+				IncludeSplits.Process(IncludeOutput);
 				
-				Subprocess LibraryFinder(PkgConfigPath->AsAbsoluteString(), {"--libs", TestName});
-				StringSplitter LibrarySplits({' '}, true);
-				while (!LibraryFinder.Out.HasFailed())
-				{
-					String Line = LibraryFinder.Out.ReadLine();
-					LibrarySplits.Process(Line);
-					if (Verbose)
-						StandardStream << "Library pkg-config output: " << Line << "\n" << OutputStream::Flush();
-				}
+				Subprocess &LibraryFinder = *Finder.second;
+				String const LibraryOutput = LibraryFinder.Out.ReadAll();
+				if (Verbose)
+					StandardStream << "Library pkg-config output: " << LibraryOutput << LibraryFinder.Error.ReadAll() << "\n" << OutputStream::Flush();
+				StringSplitter LibrarySplits({' ', '\n'}, true);
+				LibrarySplits.Process(LibraryOutput);
 
 				if ((IncludeFinder.GetResult() != 0) || 
 					(LibraryFinder.GetResult() != 0)) continue;
 
+				PackageConfig::Result Package;
 				{
 					auto Results = IncludeSplits.Results();
 					while (!Results.empty())
 					{
 						auto Result = Results.front();
 						if (Result.substr(0, 2) == "-I")
-							AddIncludeLocation(Result.substr(2));
+							Package.IncludeDirectories.push_back(Result.substr(2));
 						Results.pop();
 					}
 				}
@@ -315,23 +471,37 @@ void CLibrary::Respond(Script &State, HelpItemCollector *HelpItems)
 					{
 						auto Result = Results.front();
 						if (Result.substr(0, 2) == "-L")
-							AddLibraryLocation(Result.substr(2));
+							Package.LibraryDirectories.push_back(Result.substr(2));
 						if (Result.substr(0, 2) == "-l")
-							AddLibraryFilename(Result.substr(2));
+							Package.Libraries.push_back(Result.substr(2));
 						Results.pop();
 					}
 				}
 
-				if (Found) break;
+				if (AddPackage(LibraryNames[&Finder - &Finders[0]], Package)) break;
 			}
 		}
 	}
 
+	return Found;
+}
+
+void CLibrary::Respond(QueryState &State, HelpItemCollector *HelpItems)
+{
+	std::vector<String> LibraryNames = GetVariableArgument(State, "Name");
+	bool RequireStatic = GetFlag(State, "Static");
+	bool Optional = GetFlag(State, "Optional");
+	String const Header = GetOptionalArgument(State, "Header");
+	ClearArguments(State);
+
+	Library Result;
+	bool const Found = Find(LibraryNames, RequireStatic, Header, Result, HelpItems);
+
 	assert(State.Height() == 0);
 	if (!Found) 
 	{
 		if (!Optional)
-			throw InteractionError("Could not find required library " + LibraryName + ".  If you believe you have the library, check the help and specify the correct location on the command line.");
+			throw InteractionError("Could not find required library " + LibraryNames[0] + ".  If you believe you have the library, check the help and specify the correct location on the command line.");
 		State.PushTable();
 		return;
 	}
@@ -339,25 +509,25 @@ void CLibrary::Respond(Script &State, HelpItemCollector *HelpItems)
 	State.PushTable();
 
 	State.PushTable();
-	for (unsigned int Index = 1; Index <= LibraryFilenames.size(); ++Index) 
+	for (unsigned int Index = 1; Index <= Result.Filenames.size(); ++Index) 
 	{
-		State.PushString(LibraryFilenames[Index - 1]);
+		State.PushString(Result.Filenames[Index - 1]);
 		State.PutElement(Index);
 	}
 	State.PutElement("Filenames");
 	
 	State.PushTable();
-	for (unsigned int Index = 1; Index <= LibraryLocations.size(); ++Index) 
+	for (unsigned int Index = 1; Index <= Result.LibraryDirectories.size(); ++Index) 
 	{
-		State.PushString(LibraryLocations[Index - 1]);
+		State.PushString(Result.LibraryDirectories[Index - 1]);
 		State.PutElement(Index);
 	}
 	State.PutElement("LibraryDirectories");
 	
 	State.PushTable();
-	for (unsigned int Index = 1; Index <= IncludeLocations.size(); ++Index) 
+	for (unsigned int Index = 1; Index <= Result.IncludeDirectories.size(); ++Index) 
 	{
-		State.PushString(IncludeLocations[Index - 1]);
+		State.PushString(Result.IncludeDirectories[Index - 1]);
 		State.PutElement(Index);
 	}
 	State.PutElement("IncludeDirectories");
@@ -3,6 +3,9 @@
 
 #include "../information.h"
 #include "../ren-general/filesystem.h"
+#include "../directoryindex.h"
+#include "../ldsocache.h"
+#include "../pkgconfig.h"
 
 class CLibrary
 {
@@ -10,9 +13,25 @@ class CLibrary
 		static String GetIdentifier(void);
 		static void DisplayControllerHelp(void);
 		CLibrary(void);
-		void Respond(Script &State, HelpItemCollector *HelpItems);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+
+		struct Library
+		{
+			std::vector<String> Filenames, LibraryDirectories, IncludeDirectories;
+		};
+		// Searches for the first of LibraryNames that can be found, the same way Respond does.  Throws InteractionError if an overridden location is invalid.
+		bool Find(std::vector<String> const &LibraryNames, bool Static, String const &Header, Library &Out, HelpItemCollector *HelpItems = nullptr);
 	private:
-		std::vector<DirectoryPath> const TestLocations;
+		DirectoryIndex &GetListing(DirectoryPath const &Directory);
+		String FindIncludeRoot(DirectoryPath const &Directory);
+		bool HasHeader(DirectoryPath const &IncludeRoot, String const &Header);
+
+		std::vector<DirectoryIndex> TestLocations;
+		size_t EnvironmentLocations; // The first TestLocations, which came from LD_LIBRARY*_PATH
+		std::map<String, DirectoryIndex> Listings; // Directories read while looking for headers, shared by every lookup
+		std::map<String, String> IncludeRoots; // The nearest include directory above each library directory, empty if there is none
+		LinkerCache LoaderCache;
+		PackageConfig Packages;
 };
 
 #endif // CLIBRARY_H
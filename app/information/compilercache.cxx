@@ -0,0 +1,244 @@
+#include "compilercache.h"
+
+#include <cstdlib>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#elif !defined(WINDOWS)
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif
+
+#include "../shared.h"
+#include "../configuration.h"
+#include "../subprocess.h"
+#include "program.h"
+#include "cxxcompiler.h"
+
+extern Information::AnchorImplementation<Program> ProgramInformation;
+extern Information::AnchorImplementation<CXXCompiler> CXXCompilerInformation;
+extern bool Verbose;
+
+static bool IsLocalFilesystem(String const &Path)
+{
+#ifdef __linux__
+	struct statfs Status;
+	if (statfs(Path.c_str(), &Status) != 0) return false;
+	switch (static_cast<unsigned long>(Status.f_type))
+	{
+		case 0x6969: // NFS
+		case 0x517b: // SMB
+		case 0xfe534d42: // SMB2
+		case 0xff534d42: // CIFS
+		case 0x564c: // NCP
+		case 0x5346414f: // AFS
+		case 0x73757245: // Coda
+		case 0x01021997: // 9P
+		case 0x00c36400: // Ceph
+		case 0x65735546: // FUSE, which is usually sshfs or another network filesystem
+			return false;
+		default: return true;
+	}
+#elif defined(MNT_LOCAL)
+	struct statfs Status;
+	if (statfs(Path.c_str(), &Status) != 0) return false;
+	return (Status.f_flags & MNT_LOCAL) != 0;
+#else
+	return true;
+#endif
+}
+
+// Reads "NAME  VALUE" lines, where NAME may contain single spaces, keeping those with integer values
+static void ParseStatisticsLine(String const &Line, std::map<String, unsigned long long> &Statistics)
+{
+	size_t const ValueStart = Line.find_last_of(" \t");
+	if ((ValueStart == String::npos) || (ValueStart + 1 == Line.length())) return;
+	char *End = nullptr;
+	unsigned long long const Value = strtoull(Line.c_str() + ValueStart + 1, &End, 10);
+	if (*End != '\0') return;
+	size_t const NameEnd = Line.find_last_not_of(" \t", ValueStart);
+	if (NameEnd == String::npos) return;
+	Statistics[Line.substr(0, NameEnd + 1)] = Value;
+}
+
+CompilerCache::CompilerCache(void)
+{
+	for (auto &Name : std::vector<String>({"ccache", "sccache"}))
+	{
+		FilePath *Found = ProgramInformation->FindProgram(Name);
+#ifdef WINDOWS
+		if (Found == nullptr) Found = ProgramInformation->FindProgram(Name + ".exe");
+#endif
+		if (Found == nullptr) continue;
+		Tools.push_back(Tool{Name, *Found, String(), false, false, false, std::map<String, unsigned long long>()});
+		Examine(Tools.back());
+	}
+	if (Verbose && Tools.empty()) StandardStream << "Neither ccache nor sccache is installed.\n" << OutputStream::Flush();
+}
+
+void CompilerCache::Examine(Tool &Found)
+{
+	// The configuration and statistics are read at once; sccache reports its cache location with its statistics
+	SubprocessGroup Running;
+	Subprocess *Configuration = nullptr;
+	if (Found.Name == "ccache")
+	{
+		Configuration = &Running.Start(Found.Path, {"-p"});
+		Configuration->In.Close();
+	}
+	Subprocess &Statistics = Running.Start(Found.Path, (Found.Name == "ccache") ? std::vector<String>({"--print-stats"}) : std::vector<String>({"--show-stats"}));
+	Statistics.In.Close();
+	Running.WaitAll();
+
+	if (Configuration != nullptr)
+	{
+		// Lines look like "(default) cache_dir = /home/user/.cache/ccache"
+		String const Key = " cache_dir = ";
+		while (!Configuration->Out.HasFailed())
+		{
+			String const Line = Configuration->Out.ReadLine();
+			size_t const KeyStart = Line.find(Key);
+			if (KeyStart != String::npos) Found.CacheDirectory = Line.substr(KeyStart + Key.length());
+		}
+	}
+
+	if (Statistics.GetResult() == 0)
+	{
+		while (!Statistics.Out.HasFailed())
+		{
+			String const Line = Statistics.Out.ReadLine();
+			if (Found.Name == "ccache")
+			{
+				// --print-stats writes "NAME<tab>VALUE" lines
+				size_t const Tab = Line.find('\t');
+				if (Tab != String::npos) Found.Statistics[Line.substr(0, Tab)] = strtoull(Line.c_str() + Tab + 1, nullptr, 10);
+				continue;
+			}
+			String const Location = "Cache location";
+			if (Line.compare(0, Location.length(), Location) == 0)
+			{
+				// Like: Cache location                  Local disk: "/home/user/.cache/sccache"
+				size_t const Open = Line.find('"'), Close = Line.rfind('"');
+				if ((Line.find("Local disk") != String::npos) && (Open != String::npos) && (Close > Open))
+					Found.CacheDirectory = Line.substr(Open + 1, Close - Open - 1);
+				else Found.Remote = true;
+				continue;
+			}
+			ParseStatisticsLine(Line, Found.Statistics);
+		}
+		if (Found.Name == "ccache")
+		{
+			Found.Statistics["Hits"] = Found.Statistics["direct_cache_hit"] + Found.Statistics["preprocessed_cache_hit"];
+			Found.Statistics["Misses"] = Found.Statistics["cache_miss"];
+		}
+		else
+		{
+			Found.Statistics["Hits"] = Found.Statistics["Cache hits"];
+			Found.Statistics["Misses"] = Found.Statistics["Cache misses"];
+		}
+	}
+	else if (Verbose) StandardStream << "Couldn't read statistics from \"" << Found.Path << "\": " << Statistics.Error.ReadAll() << "\n" << OutputStream::Flush();
+
+	if (!Found.CacheDirectory.empty())
+	{
+		// The cache directory is created on first use, so check the directory it will be created in
+		String const Existing = FindExistingAncestor(DirectoryPath::Qualify(Found.CacheDirectory)).AsAbsoluteString();
+		Found.Writable = access(Existing.c_str(), W_OK) == 0;
+		Found.Local = IsLocalFilesystem(Existing);
+	}
+	if (Verbose)
+	{
+		StandardStream << "Found " << Found.Name << " at \"" << Found.Path << "\"";
+		if (Found.Remote) StandardStream << " with a remote cache.\n";
+		else if (Found.CacheDirectory.empty()) StandardStream << " but couldn't determine its cache directory.\n";
+		else StandardStream << " with cache directory \"" << Found.CacheDirectory << "\", which is " << (Found.Writable ? "" : "not ") << "writable and " << (Found.Local ? "local" : "not local") << ".\n";
+		StandardStream << OutputStream::Flush();
+	}
+}
+
+String CompilerCache::GetIdentifier(void) { return "CompilerCache"; }
+
+void CompilerCache::DisplayControllerHelp(void)
+{
+	StandardStream << "\tDiscover." << GetIdentifier() << "{Compiler = PATH}\n"
+		"\tResult: {Name = NAME, Path = CACHEPATH, CacheDirectory = DIRECTORY, Command = {CACHEPATH, PATH}, Statistics = {Hits = COUNT, Misses = COUNT, STATISTIC = COUNT...}}\n"
+		"\tFinds a compiler cache, ccache or sccache, that can be used to wrap compiler invocations.  A cache is only used if its cache directory is writable and on a local filesystem, or if it uses a remote cache.  NAME is the chosen cache, and CACHEPATH is its full path.  Command is the command that runs the compiler at PATH, or the compiler found by the most recent Discover.CXXCompiler if PATH is omitted, through the cache.  If no cache can be used, Name, Path, CacheDirectory, and Statistics are missing and Command only contains the compiler.  Command is missing if no compiler is known.\n"
+		"\tStatistics holds every counter from the cache's statistics output under the cache's own names, as well as Hits and Misses, which are the same for both caches.\n"
+		"\n";
+}
+
+void CompilerCache::Respond(QueryState &State, HelpItemCollector *HelpItems)
+{
+	String const CompilerArgument = GetOptionalArgument(State, "Compiler");
+	ClearArguments(State);
+
+	if (HelpItems != nullptr)
+		HelpItems->Add(GetIdentifier() + "=MODE", "Off disables compiler caching.  On uses the first installed compiler cache even if its cache directory fails the checks.  Any other MODE is the path of the compiler cache program to use.");
+	std::pair<bool, String> OverrideMode = FindConfiguration(GetIdentifier());
+
+	Tool const *Chosen = nullptr;
+	std::unique_ptr<Tool> Forced;
+	if (OverrideMode.first && (OverrideMode.second == "Off"))
+	{
+		if (Verbose) StandardStream << "Compiler caching disabled by configuration.\n" << OutputStream::Flush();
+	}
+	else if (OverrideMode.first && (OverrideMode.second != "On"))
+	{
+		if (Verbose) StandardStream << "Using compiler cache \"" << OverrideMode.second << "\" specified by configuration.\n" << OutputStream::Flush();
+		FilePath const Path = FilePath::Qualify(OverrideMode.second);
+		if (!Path.Exists()) throw InteractionError("The compiler cache \"" + OverrideMode.second + "\" was specified by configuration but does not exist.");
+		Forced.reset(new Tool{(Path.File().find("sccache") != String::npos) ? "sccache" : "ccache", Path, String(), false, false, false, std::map<String, unsigned long long>()});
+		Examine(*Forced);
+		Chosen = Forced.get();
+	}
+	else
+	{
+		bool const Force = OverrideMode.first;
+		for (auto &Current : Tools)
+			if (Force || Current.Remote || (Current.Writable && Current.Local))
+			{
+				Chosen = &Current;
+				break;
+			}
+		if (Verbose && (Chosen == nullptr) && !Tools.empty()) StandardStream << "No installed compiler cache has a writable local cache directory.\n" << OutputStream::Flush();
+	}
+
+	std::unique_ptr<FilePath> Compiler;
+	if (!CompilerArgument.empty()) Compiler.reset(new FilePath(FilePath::Qualify(CompilerArgument)));
+	else if (CXXCompilerInformation->GetCompiler() != nullptr) Compiler.reset(new FilePath(*CXXCompilerInformation->GetCompiler()));
+
+	State.PushTable();
+	if (Chosen != nullptr)
+	{
+		State.PushString(Chosen->Name);
+		State.PutElement("Name");
+		State.PushString(Chosen->Path.AsAbsoluteString());
+		State.PutElement("Path");
+		if (!Chosen->CacheDirectory.empty())
+		{
+			State.PushString(Chosen->CacheDirectory);
+			State.PutElement("CacheDirectory");
+		}
+		State.PushTable();
+		for (auto &Statistic : Chosen->Statistics)
+		{
+			State.PushInteger(Statistic.second);
+			State.PutElement(Statistic.first);
+		}
+		State.PutElement("Statistics");
+	}
+	if (Compiler)
+	{
+		unsigned int Index = 1;
+		State.PushTable();
+		if (Chosen != nullptr)
+		{
+			State.PushString(Chosen->Path.AsAbsoluteString());
+			State.PutElement(Index++);
+		}
+		State.PushString(Compiler->AsAbsoluteString());
+		State.PutElement(Index++);
+		State.PutElement("Command");
+	}
+}
+
@@ -0,0 +1,31 @@
+#ifndef COMPILERCACHE_H
+#define COMPILERCACHE_H
+
+#include <map>
+
+#include "../information.h"
+
+class CompilerCache
+{
+	public:
+		CompilerCache(void);
+		static String GetIdentifier(void);
+		static void DisplayControllerHelp(void);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+		static bool const AnswersVaryBetweenRuns = true; // Because of cache statistics
+
+	private:
+		struct Tool
+		{
+			String Name; // ccache or sccache
+			FilePath Path;
+			String CacheDirectory; // Empty for remote caches or if it couldn't be determined
+			bool Remote, Writable, Local;
+			std::map<String, unsigned long long> Statistics;
+		};
+		void Examine(Tool &Found);
+
+		std::vector<Tool> Tools; // Installed tools, in order of preference
+};
+
+#endif // COMPILERCACHE_H
@@ -0,0 +1,311 @@
+#include "cpu.h"
+
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#endif
+
+#include "../shared.h"
+#include "../configuration.h"
+#include "platform.h"
+
+extern bool Verbose;
+extern Information::AnchorImplementation<Platform> PlatformInformation;
+
+#if defined(__x86_64__) || defined(__i386__)
+struct CPUIDBit
+{
+	unsigned int Leaf, Subleaf;
+	char Register;
+	unsigned int Bit;
+	char const *Name;
+};
+
+// Names are GCC's -m option names in uppercase, with . replaced by _
+static CPUIDBit const X86Features[] =
+{
+	{1, 0, 'd', 8, "CX8"}, {1, 0, 'd', 15, "CMOV"}, {1, 0, 'd', 23, "MMX"}, {1, 0, 'd', 24, "FXSR"}, {1, 0, 'd', 25, "SSE"}, {1, 0, 'd', 26, "SSE2"},
+	{1, 0, 'c', 0, "SSE3"}, {1, 0, 'c', 1, "PCLMUL"}, {1, 0, 'c', 9, "SSSE3"}, {1, 0, 'c', 12, "FMA"}, {1, 0, 'c', 13, "CX16"},
+	{1, 0, 'c', 19, "SSE4_1"}, {1, 0, 'c', 20, "SSE4_2"}, {1, 0, 'c', 22, "MOVBE"}, {1, 0, 'c', 23, "POPCNT"}, {1, 0, 'c', 25, "AES"},
+	{1, 0, 'c', 26, "XSAVE"}, {1, 0, 'c', 28, "AVX"}, {1, 0, 'c', 29, "F16C"}, {1, 0, 'c', 30, "RDRND"},
+	{7, 0, 'b', 3, "BMI"}, {7, 0, 'b', 5, "AVX2"}, {7, 0, 'b', 8, "BMI2"}, {7, 0, 'b', 16, "AVX512F"}, {7, 0, 'b', 17, "AVX512DQ"},
+	{7, 0, 'b', 18, "RDSEED"}, {7, 0, 'b', 19, "ADX"}, {7, 0, 'b', 21, "AVX512IFMA"}, {7, 0, 'b', 28, "AVX512CD"}, {7, 0, 'b', 29, "SHA"},
+	{7, 0, 'b', 30, "AVX512BW"}, {7, 0, 'b', 31, "AVX512VL"},
+	{7, 0, 'c', 1, "AVX512VBMI"}, {7, 0, 'c', 6, "AVX512VBMI2"}, {7, 0, 'c', 8, "GFNI"}, {7, 0, 'c', 9, "VAES"}, {7, 0, 'c', 10, "VPCLMULQDQ"},
+	{7, 0, 'c', 11, "AVX512VNNI"}, {7, 0, 'c', 12, "AVX512BITALG"}, {7, 0, 'c', 14, "AVX512VPOPCNTDQ"},
+	{7, 0, 'd', 23, "AVX512FP16"},
+	{7, 1, 'a', 4, "AVXVNNI"}, {7, 1, 'a', 5, "AVX512BF16"},
+	{0x80000001, 0, 'c', 0, "SAHF"}, {0x80000001, 0, 'c', 5, "LZCNT"}, {0x80000001, 0, 'c', 6, "SSE4A"}, {0x80000001, 0, 'c', 11, "XOP"}, {0x80000001, 0, 'c', 16, "FMA4"},
+};
+
+// Features that need the operating system to save the wider registers
+static bool NeedsAVXState(String const &Feature)
+{
+	return (Feature.compare(0, 3, "AVX") == 0) || (Feature == "FMA") || (Feature == "F16C") || (Feature == "VAES") || (Feature == "VPCLMULQDQ") || (Feature == "XOP") || (Feature == "FMA4");
+}
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+struct HardwareCapabilityBit
+{
+	bool Second; // AT_HWCAP2 rather than AT_HWCAP
+	unsigned int Bit;
+	char const *Name;
+};
+
+static HardwareCapabilityBit const ARMFeatures[] =
+{
+#ifdef __aarch64__
+	{false, 0, "FP"}, {false, 1, "ASIMD"}, {false, 3, "AES"}, {false, 4, "PMULL"}, {false, 5, "SHA1"}, {false, 6, "SHA2"}, {false, 7, "CRC32"},
+	{false, 8, "ATOMICS"}, {false, 9, "FPHP"}, {false, 10, "ASIMDHP"}, {false, 12, "ASIMDRDM"}, {false, 17, "SHA3"}, {false, 18, "SM3"},
+	{false, 19, "SM4"}, {false, 20, "ASIMDDP"}, {false, 21, "SHA512"}, {false, 22, "SVE"},
+	{true, 1, "SVE2"}, {true, 13, "I8MM"}, {true, 14, "BF16"},
+#else
+	{false, 12, "NEON"}, {false, 16, "VFPV4"}, {false, 17, "IDIVA"},
+	{true, 0, "AES"}, {true, 1, "PMULL"}, {true, 2, "SHA1"}, {true, 3, "SHA2"}, {true, 4, "CRC32"},
+#endif
+};
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || (defined(__linux__) && (defined(__aarch64__) || defined(__arm__)))
+static bool HasAll(Set<String> const &Features, std::initializer_list<char const *> Names)
+{
+	for (auto Name : Names) if (!Features.Contains(Name)) return false;
+	return true;
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+// The x86-64 psABI microarchitecture level the features satisfy
+static unsigned int GetX86Level(Set<String> const &Features)
+{
+	if (!HasAll(Features, {"CMOV", "CX8", "FXSR", "MMX", "SSE", "SSE2"})) return 0;
+	if (!HasAll(Features, {"CX16", "SAHF", "POPCNT", "SSE3", "SSE4_1", "SSE4_2", "SSSE3"})) return 1;
+	if (!HasAll(Features, {"AVX", "AVX2", "BMI", "BMI2", "F16C", "FMA", "LZCNT", "MOVBE"})) return 2;
+	if (!HasAll(Features, {"AVX512F", "AVX512BW", "AVX512CD", "AVX512DQ", "AVX512VL"})) return 3;
+	return 4;
+}
+
+static String GetX86March(unsigned int Level)
+{
+	if (PlatformInformation->GetArchitectureBits() != 64) return "i686";
+	if (Level <= 1) return "x86-64";
+	return MemoryStream() << "x86-64-v" << Level;
+}
+#endif
+
+CPU::CPU(void) : Vendor("unknown"), Family(0), Model(0), Level(0)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int Registers[4]; // eax, ebx, ecx, edx
+	unsigned int const MaximumLeaf = __get_cpuid_max(0, nullptr), MaximumExtendedLeaf = __get_cpuid_max(0x80000000, nullptr);
+	if (MaximumLeaf >= 1)
+	{
+		__cpuid(0, Registers[0], Registers[1], Registers[2], Registers[3]);
+		char VendorText[13];
+		memcpy(VendorText, &Registers[1], 4);
+		memcpy(VendorText + 4, &Registers[3], 4);
+		memcpy(VendorText + 8, &Registers[2], 4);
+		VendorText[12] = 0;
+		Vendor = VendorText;
+
+		__cpuid(1, Registers[0], Registers[1], Registers[2], Registers[3]);
+		unsigned int const BaseFamily = (Registers[0] >> 8) & 0xf, BaseModel = (Registers[0] >> 4) & 0xf;
+		Family = BaseFamily == 0xf ? BaseFamily + ((Registers[0] >> 20) & 0xff) : BaseFamily;
+		Model = ((BaseFamily == 0x6) || (BaseFamily == 0xf)) ? (((Registers[0] >> 16) & 0xf) << 4) + BaseModel : BaseModel;
+	}
+	for (auto &Feature : X86Features)
+	{
+		if ((Feature.Leaf < 0x80000000) ? (Feature.Leaf > MaximumLeaf) : (Feature.Leaf > MaximumExtendedLeaf)) continue;
+		__cpuid_count(Feature.Leaf, Feature.Subleaf, Registers[0], Registers[1], Registers[2], Registers[3]);
+		unsigned int const Value = Registers[Feature.Register - 'a'];
+		if ((Value >> Feature.Bit) & 1) Features.insert(Feature.Name);
+	}
+	// cpuid reports what the processor has, but AVX registers are only usable if the kernel saves them
+	uint64_t EnabledState = 0;
+	if (MaximumLeaf >= 1)
+	{
+		__cpuid(1, Registers[0], Registers[1], Registers[2], Registers[3]);
+		if ((Registers[2] >> 27) & 1) // OSXSAVE
+		{
+			uint32_t Low, High;
+			__asm__ volatile ("xgetbv" : "=a"(Low), "=d"(High) : "c"(0));
+			EnabledState = (static_cast<uint64_t>(High) << 32) | Low;
+		}
+	}
+	bool const HaveAVXState = (EnabledState & 0x6) == 0x6, HaveAVX512State = (EnabledState & 0xe6) == 0xe6;
+	for (auto Feature = Features.begin(); Feature != Features.end(); )
+	{
+		if ((NeedsAVXState(*Feature) && !HaveAVXState) || ((Feature->compare(0, 6, "AVX512") == 0) && !HaveAVX512State))
+			Feature = Features.erase(Feature);
+		else ++Feature;
+	}
+	if (MaximumExtendedLeaf >= 0x80000004)
+	{
+		char NameText[49];
+		for (unsigned int Part = 0; Part < 3; ++Part)
+		{
+			__cpuid(0x80000002 + Part, Registers[0], Registers[1], Registers[2], Registers[3]);
+			memcpy(NameText + Part * 16, Registers, 16);
+		}
+		NameText[48] = 0;
+		Name = NameText;
+		size_t const Start = Name.find_first_not_of(' '), End = Name.find_last_not_of(' ');
+		Name = (Start == String::npos) ? String() : Name.substr(Start, End - Start + 1);
+	}
+	Level = PlatformInformation->GetArchitectureBits() == 64 ? GetX86Level(Features) : 0;
+	March = GetX86March(Level);
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+	unsigned long const Capabilities[2] = {getauxval(AT_HWCAP), getauxval(AT_HWCAP2)};
+	for (auto &Feature : ARMFeatures)
+		if ((Capabilities[Feature.Second ? 1 : 0] >> Feature.Bit) & 1) Features.insert(Feature.Name);
+
+	// The main ID register, which the kernel exposes to unprivileged readers
+	std::ifstream Identification("/sys/devices/system/cpu/cpu0/regs/identification/midr_el1");
+	unsigned long long Register = 0;
+	if (Identification >> std::hex >> Register)
+	{
+		unsigned int const Implementer = (Register >> 24) & 0xff;
+		switch (Implementer)
+		{
+			case 0x41: Vendor = "ARM"; break;
+			case 0x42: Vendor = "Broadcom"; break;
+			case 0x43: Vendor = "Cavium"; break;
+			case 0x48: Vendor = "HiSilicon"; break;
+			case 0x4e: Vendor = "NVIDIA"; break;
+			case 0x51: Vendor = "Qualcomm"; break;
+			case 0x61: Vendor = "Apple"; break;
+			case 0xc0: Vendor = "Ampere"; break;
+			default:
+			{
+				char Text[8];
+				snprintf(Text, sizeof(Text), "0x%02x", Implementer);
+				Vendor = Text;
+				break;
+			}
+		}
+		Family = (Register >> 16) & 0xf;
+		Model = (Register >> 4) & 0xfff;
+	}
+#ifdef __aarch64__
+	March = "armv8-a";
+	if (Features.Contains("CRC32")) March += "+crc";
+	if (HasAll(Features, {"AES", "PMULL", "SHA1", "SHA2"})) March += "+crypto";
+	if (Features.Contains("ATOMICS")) March += "+lse";
+	if (Features.Contains("ASIMDRDM")) March += "+rdma";
+	if (Features.Contains("ASIMDDP")) March += "+dotprod";
+	if (Features.Contains("FPHP")) March += "+fp16";
+	if (Features.Contains("SVE")) March += "+sve";
+	if (Features.Contains("SVE2")) March += "+sve2";
+#else
+	if (Features.Contains("CRC32")) March = "armv8-a+crc";
+	else if (HasAll(Features, {"NEON", "VFPV4"})) March = "armv7-a+neon-vfpv4";
+	else if (Features.Contains("NEON")) March = "armv7-a+neon";
+	else March = "armv7-a";
+#endif
+#endif
+
+	std::pair<bool, String> OverrideVendor = FindConfiguration(GetIdentifier() + "Vendor"),
+		OverrideFeatures = FindConfiguration(GetIdentifier() + "Features"),
+		OverrideLevel = FindConfiguration(GetIdentifier() + "Level"),
+		OverrideMarch = FindConfiguration(GetIdentifier() + "March");
+	if (OverrideVendor.first)
+	{
+		if (Verbose) StandardStream << "Found CPU vendor by configuration.\n" << OutputStream::Flush();
+		Vendor = OverrideVendor.second;
+	}
+	if (OverrideFeatures.first)
+	{
+		if (Verbose) StandardStream << "Found CPU features by configuration.\n" << OutputStream::Flush();
+		Features.clear();
+		std::queue<String> Parts = StringSplitter({','}, true).Process(OverrideFeatures.second).Results();
+		while (!Parts.empty())
+		{
+			Features.insert(Parts.front());
+			Parts.pop();
+		}
+#if defined(__x86_64__) || defined(__i386__)
+		Level = PlatformInformation->GetArchitectureBits() == 64 ? GetX86Level(Features) : 0;
+		March = GetX86March(Level);
+#endif
+	}
+	if (OverrideLevel.first)
+	{
+		if (Verbose) StandardStream << "Found CPU microarchitecture level by configuration.\n" << OutputStream::Flush();
+		MemoryStream(OverrideLevel.second) >> Level;
+#if defined(__x86_64__) || defined(__i386__)
+		March = GetX86March(Level);
+#endif
+	}
+	if (OverrideMarch.first)
+	{
+		if (Verbose) StandardStream << "Found CPU -march value by configuration.\n" << OutputStream::Flush();
+		March = OverrideMarch.second;
+	}
+
+	if (Verbose)
+	{
+		StandardStream << "Determined CPU vendor " << Vendor << ", family " << Family << ", model " << Model << ", level " << Level << ", -march=" << March << ", features:";
+		for (auto &Feature : Features) StandardStream << " " << Feature;
+		StandardStream << "\n" << OutputStream::Flush();
+	}
+}
+
+String CPU::GetIdentifier(void) { return "CPU"; }
+
+void CPU::DisplayControllerHelp(void)
+{
+	StandardStream << "\tDiscover." << GetIdentifier() << "{}\n"
+		"\tResult: {Vendor = VENDOR, Name = NAME, Family = FAMILY, Model = MODEL, Features = {FEATURE = true...}, Level = LEVEL, March = MARCH}\n"
+		"\tDescribes the processor discovery is running on, from cpuid on x86 and the kernel's hardware capability bits on ARM.  VENDOR is the cpuid vendor string (such as GenuineIntel or AuthenticAMD) or the ARM implementer.  FEATURE names are GCC's -m option names in uppercase with . replaced by _ (SSE4_2, AVX2, AVX512F, BMI2, FMA...) on x86 and the kernel's capability names (ASIMD, SVE, CRC32...) on ARM; features the operating system hasn't enabled are left out.  LEVEL is the highest x86-64 psABI microarchitecture level supported (1 to 4), or 0 elsewhere.  MARCH is a suggested value for the compiler's -march flag.\n"
+		"\n";
+}
+
+void CPU::Respond(QueryState &State, HelpItemCollector *HelpItems)
+{
+	if (HelpItems != nullptr)
+	{
+		HelpItems->Add(GetIdentifier() + "Vendor=VENDOR", "Overrides the detected processor vendor.");
+		HelpItems->Add(GetIdentifier() + "Features=FEATURE,FEATURE...", "Overrides the detected processor features, for building for another machine.  On x86 the microarchitecture level and -march suggestion are derived from FEATURE values.");
+		HelpItems->Add(GetIdentifier() + "Level=LEVEL", "Overrides the detected x86-64 microarchitecture level, and the -march suggestion along with it.");
+		HelpItems->Add(GetIdentifier() + "March=MARCH", "Overrides the suggested -march value.");
+	}
+	State.PushTable();
+	State.PushString(Vendor);
+	State.PutElement("Vendor");
+	if (!Name.empty())
+	{
+		State.PushString(Name);
+		State.PutElement("Name");
+	}
+	State.PushInteger(Family);
+	State.PutElement("Family");
+	State.PushInteger(Model);
+	State.PutElement("Model");
+	State.PushTable();
+	for (auto &Feature : Features)
+	{
+		State.PushBoolean(true);
+		State.PutElement(Feature);
+	}
+	State.PutElement("Features");
+	State.PushInteger(Level);
+	State.PutElement("Level");
+	if (!March.empty())
+	{
+		State.PushString(March);
+		State.PutElement("March");
+	}
+}
+
+String const &CPU::GetVendor(void) const { return Vendor; }
+
+Set<String> const &CPU::GetFeatures(void) const { return Features; }
+
+unsigned int CPU::GetLevel(void) const { return Level; }
+
+String const &CPU::GetMarch(void) const { return March; }
+
@@ -0,0 +1,27 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include "../information.h"
+
+class CPU
+{
+	public:
+		CPU(void);
+		static String GetIdentifier(void);
+		static void DisplayControllerHelp(void);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+		String const &GetVendor(void) const;
+		Set<String> const &GetFeatures(void) const;
+		unsigned int GetLevel(void) const;
+		String const &GetMarch(void) const;
+
+	private:
+		String Vendor, Name;
+		unsigned int Family, Model;
+		Set<String> Features;
+		unsigned int Level; // x86-64 psABI microarchitecture level, 0 on other architectures
+		String March;
+};
+
+#endif // CPU_H
+
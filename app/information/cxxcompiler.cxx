@@ -1,19 +1,55 @@
 #include "cxxcompiler.h"
 
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
 #include "../ren-general/arrangement.h"
 #include "../ren-general/filesystem.h"
 
 #include "../shared.h"
 #include "../configuration.h"
 #include "../subprocess.h"
+#include "../probecache.h"
 #include "program.h"
 
 extern Information::AnchorImplementation<Program> ProgramInformation;
+extern ProbeCache ProbeResults;
 extern bool Verbose;
 
 namespace SupportFlags
 {
 	String const Generation2011("CXX11");
+	String const Generation2014("CXX14");
+	String const Generation2017("CXX17");
+	String const Generation2020("CXX20");
+	String const Generation2023("CXX23");
+	String const HasInclude("HasInclude");
+}
+
+struct LanguageLevel
+{
+	String const &Flag;
+	String const Standard; // The provisional names are used since newer compilers still accept them and older ones accept nothing else
+	unsigned long const PreviousCPlusPlus; // A compiler supports the level if its __cplusplus is newer than the previous level's
+};
+
+std::vector<LanguageLevel> const LanguageLevels
+{
+	{SupportFlags::Generation2011, "c++0x", 199711},
+	{SupportFlags::Generation2014, "c++1y", 201103},
+	{SupportFlags::Generation2017, "c++1z", 201402},
+	{SupportFlags::Generation2020, "c++2a", 201703},
+	{SupportFlags::Generation2023, "c++2b", 202002}
+};
+
+static String PrintSupportFlags(void)
+{
+	MemoryStream Out;
+	for (auto &Level : LanguageLevels) Out << Level.Flag << ", ";
+	Out << SupportFlags::HasInclude;
+	return Out;
 }
 
 namespace Compilers
@@ -34,50 +70,320 @@ String PrintCompilerClasses(void)
 		;
 }
 
-static bool CompileExample(FilePath const &CompilerPath, String const &Example, std::vector<String> Arguments)
+// Makes an example available at a path for compilers that can't read source from standard input.  This is an anonymous memory file where possible and a temporary file otherwise.
+class ExampleFile
+{
+	public:
+		ExampleFile(String const &Example) : Descriptor(-1)
+		{
+#ifdef __linux__
+			// Not close-on-exec, so the compiler inherits the descriptor and can open it through its own /proc/self/fd
+			Descriptor = syscall(SYS_memfd_create, "selfdiscovery-example", 0);
+			if (Descriptor != -1)
+			{
+				String const Contents = Example + "\n";
+				if (write(Descriptor, Contents.c_str(), Contents.length()) == (ssize_t)Contents.length())
+				{
+					Path = "/proc/self/fd/" + AsString(Descriptor);
+					return;
+				}
+				close(Descriptor);
+				Descriptor = -1;
+			}
+#endif
+			auto TestFile = CreateTemporaryFile(LocateTemporaryDirectory());
+			std::get<1>(TestFile) << Example << "\n" << OutputStream::Flush();
+			Path = std::get<0>(TestFile).AsAbsoluteString();
+			TemporaryFile.reset(new FilePath(std::get<0>(TestFile)));
+		}
+
+		~ExampleFile(void)
+		{
+			if (Descriptor != -1) close(Descriptor);
+			if (TemporaryFile) TemporaryFile->Delete();
+		}
+
+		String const &GetPath(void) const { return Path; }
+
+	private:
+		int Descriptor;
+		String Path;
+		std::unique_ptr<FilePath> TemporaryFile;
+};
+
+static bool ReadsStandardInput(String const &CompilerClass)
+{
+	return (CompilerClass == Compilers::GXX) || (CompilerClass == Compilers::Clang);
+}
+
+// Target and language macros that are passed on to the controller; the rest of the predefined macros are compiler internals
+static bool IsReportedMacro(String const &Name)
 {
-	auto TestFile = CreateTemporaryFile(LocateTemporaryDirectory());
-	std::get<1>(TestFile) << Example << "\n" << OutputStream::Flush();
-	Arguments.push_back(std::get<0>(TestFile).AsAbsoluteString());
-	try
+	static Set<String> const TargetMacros
 	{
-		Subprocess Compiler(CompilerPath.AsAbsoluteString(), Arguments);
-		if (Verbose)
-			while (!Compiler.Out.HasFailed())
-				StandardStream << "Compiler output: " << Compiler.Out.ReadLine() << "\n" << OutputStream::Flush();
-		else Compiler.Out.ReadToEnd();
-		std::get<0>(TestFile).Delete();
-		return Compiler.GetResult() == 0;
-	}
-	catch (InteractionError &Failure)
+		"__cplusplus", "__GNUC__", "__GNUC_MINOR__", "__clang__", "__clang_major__", "__clang_minor__", "__GXX_ABI_VERSION",
+		"__STDCPP_DEFAULT_NEW_ALIGNMENT__", "__BYTE_ORDER__", "__ORDER_LITTLE_ENDIAN__", "__ORDER_BIG_ENDIAN__", "__LP64__", "__ILP32__", "__ELF__",
+		"__linux__", "__APPLE__", "__FreeBSD__", "__OpenBSD__", "__NetBSD__", "_WIN32", "_WIN64", "__MINGW32__",
+		"__x86_64__", "__i386__", "__aarch64__", "__arm__", "__ARM_NEON", "__powerpc64__", "__s390x__", "__riscv", "__riscv_xlen",
+		"__SSE__", "__SSE2__", "__SSE3__", "__SSSE3__", "__SSE4_1__", "__SSE4_2__", "__AVX__", "__AVX2__", "__AVX512F__", "__FMA__", "__BMI__", "__BMI2__"
+	};
+	return (Name.compare(0, 6, "__cpp_") == 0) ||
+		(Name.compare(0, 9, "__SIZEOF_") == 0) ||
+		(Name.compare(0, 13, "__has_include") == 0) ||
+		TargetMacros.Contains(Name);
+}
+
+// Parses "#define NAME VALUE" lines, skipping function-like macros
+static std::map<String, String> ParseMacros(String const &Dump)
+{
+	std::map<String, String> Out;
+	String const Prefix = "#define ";
+	size_t LineStart = 0;
+	while (LineStart < Dump.length())
 	{
-		std::get<0>(TestFile).Delete();
-		throw Failure;
+		size_t LineEnd = Dump.find('\n', LineStart);
+		if (LineEnd == String::npos) LineEnd = Dump.length();
+		if (Dump.compare(LineStart, Prefix.length(), Prefix) == 0)
+		{
+			size_t const NameStart = LineStart + Prefix.length();
+			size_t NameEnd = Dump.find_first_of(" (", NameStart);
+			if ((NameEnd == String::npos) || (NameEnd > LineEnd)) NameEnd = LineEnd;
+			if ((NameEnd == LineEnd) || (Dump[NameEnd] == ' '))
+				Out[Dump.substr(NameStart, NameEnd - NameStart)] =
+					(NameEnd == LineEnd) ? String() : Dump.substr(NameEnd + 1, LineEnd - NameEnd - 1);
+			else if (Dump.compare(NameStart, NameEnd - NameStart, "__has_include") == 0)
+				Out["__has_include"] = String();
+		}
+		LineStart = LineEnd + 1;
 	}
+	return Out;
 }
 
+struct CompilerFeatures
+{
+	std::map<String, bool> Flags;
+	std::map<String, String> Macros; // From the newest supported language level
+};
+
+String const CXX11Example = "#include <functional>\nint main(int argc, char **argv) { std::function<void(void)> a; return 0; }";
+
+// Probes one candidate compiler without blocking.  Subprocesses are started in a group shared by all candidates and handed back through Consume as they finish, so every candidate is probed at once.
+class CompilerProbe
+{
+	public:
+		CompilerProbe(FilePath const &Compiler, String const &Class, std::vector<String> const &RequiredFlags, SubprocessGroup &Running) :
+			Compiler(Compiler), Class(Class), RequiredFlags(RequiredFlags), Running(Running), Decided(false), Verdict(false),
+			Dumps(LanguageLevels.size()), Dumpers(LanguageLevels.size(), nullptr), OutstandingDumps(0), LibraryTest(nullptr)
+		{
+			if (Verbose) StandardStream << "Testing compiler \"" << Compiler << "\".\n" << OutputStream::Flush();
+			if (Class.empty())
+			{
+				// Unrecognized compilers can't be tested, so they only have to exist
+				Decide(Compiler.Exists(), "Overridden compiler doesn't seem to exist");
+				return;
+			}
+
+			// Dump the predefined macros once per language level, and derive every feature flag from the dumps
+			for (unsigned int Index = 0; Index < LanguageLevels.size(); ++Index)
+			{
+				std::pair<bool, String> Cached = ProbeResults.Find(Compiler, "macros -std=" + LanguageLevels[Index].Standard);
+				if (Cached.first)
+				{
+					Dumps[Index] = Cached.second;
+					continue;
+				}
+				Dumpers[Index] = &Running.Start(Compiler, {"-x", "c++", "-dM", "-E", "-std=" + LanguageLevels[Index].Standard, "-"});
+				Dumpers[Index]->In.Close();
+				++OutstandingDumps;
+			}
+			if (OutstandingDumps == 0) FinishDumps();
+		}
+
+		bool Consume(Subprocess &Done) // Returns false if Done belongs to another probe
+		{
+			for (unsigned int Index = 0; Index < LanguageLevels.size(); ++Index)
+			{
+				if (Dumpers[Index] != &Done) continue;
+				Dumpers[Index] = nullptr;
+				String const Output = Done.Out.ReadAll();
+				PrintErrors(Done);
+				if (Done.GetResult() == 0)
+				{
+					// Only the reported macros are kept, which keeps the cache small
+					MemoryStream Filtered;
+					for (auto &Macro : ParseMacros(Output))
+						if (IsReportedMacro(Macro.first))
+							Filtered << "#define " << Macro.first << (Macro.second.empty() ? "" : " ") << Macro.second << "\n";
+					Dumps[Index] = Filtered;
+				}
+				// A compiler rejecting the level is worth remembering, but not one that couldn't run
+				if (Done.ExitedNormally()) ProbeResults.Store(Compiler, "macros -std=" + LanguageLevels[Index].Standard, Dumps[Index]);
+				if (--OutstandingDumps == 0) FinishDumps();
+				return true;
+			}
+
+			if (LibraryTest != &Done) return false;
+			LibraryTest = nullptr;
+			LibraryExample.reset();
+			if (Verbose) StandardStream << "Compiler output:\n" << Done.Out.ReadAll() << OutputStream::Flush();
+			PrintErrors(Done);
+			bool const Passed = Done.GetResult() == 0;
+			ProbeResults.Store(Compiler, LibraryTestQuery, Passed ? "1" : "0");
+			Decide(Passed, "Compiler can't compile with its standard library");
+			return true;
+		}
+
+		void Cancel(void)
+		{
+			for (auto &Dumper : Dumpers)
+				if (Dumper != nullptr)
+				{
+					Running.Cancel(*Dumper);
+					Dumper = nullptr;
+				}
+			if (LibraryTest != nullptr)
+			{
+				Running.Cancel(*LibraryTest);
+				LibraryTest = nullptr;
+			}
+		}
+
+		bool IsDecided(void) const { return Decided; }
+		bool Passed(void) const { return Decided && Verdict; }
+		FilePath const &GetCompiler(void) const { return Compiler; }
+		CompilerFeatures const *GetFeatures(void) const { return Class.empty() ? nullptr : &Features; }
+
+	private:
+		void Decide(bool Passed, String const &FailureReason)
+		{
+			Decided = true;
+			Verdict = Passed;
+			if (Verbose)
+			{
+				if (Passed) StandardStream << "Compiler \"" << Compiler << "\" passed all tests.\n" << OutputStream::Flush();
+				else StandardStream << FailureReason << " (\"" << Compiler << "\").\n" << OutputStream::Flush();
+			}
+		}
+
+		void PrintErrors(Subprocess &Done)
+		{
+			if (!Verbose) return;
+			String const Errors = Done.Error.ReadAll();
+			if (!Errors.empty()) StandardStream << "Compiler output:\n" << Errors << OutputStream::Flush();
+		}
+
+		void FinishDumps(void)
+		{
+			bool HasInclude = false;
+			for (unsigned int Index = 0; Index < LanguageLevels.size(); ++Index)
+			{
+				std::map<String, String> Macros = ParseMacros(Dumps[Index]);
+				unsigned long CPlusPlus = 0;
+				auto FoundCPlusPlus = Macros.find("__cplusplus");
+				if (FoundCPlusPlus != Macros.end()) MemoryStream(FoundCPlusPlus->second) >> CPlusPlus;
+				bool const Supported = CPlusPlus > LanguageLevels[Index].PreviousCPlusPlus;
+				Features.Flags[LanguageLevels[Index].Flag] = Supported;
+				if (!Supported) continue;
+				if (Macros.find("__has_include") != Macros.end()) HasInclude = true;
+				Features.Macros = std::move(Macros);
+			}
+			Features.Flags[SupportFlags::HasInclude] = HasInclude || Features.Flags[SupportFlags::Generation2017];
+			Features.Macros.erase("__has_include");
+
+			String NewestRequired;
+			for (auto &Flag : RequiredFlags)
+			{
+				if (!Features.Flags[Flag])
+				{
+					Decide(false, "Compiler doesn't seem to support " + Flag);
+					return;
+				}
+				for (auto &Level : LanguageLevels) if (Level.Flag == Flag) NewestRequired = Level.Standard;
+			}
+			if (NewestRequired.empty())
+			{
+				Decide(true, String());
+				return;
+			}
+
+			// The macros show the language level works, but not that the standard library does
+			std::vector<String> Arguments({"-x", "c++", "-fsyntax-only", "-std=" + NewestRequired});
+			MemoryStream Query;
+			Query << "compile";
+			for (auto &Argument : Arguments) Query << " " << Argument;
+			Query << " " << HashString(CXX11Example);
+			LibraryTestQuery = Query;
+			std::pair<bool, String> Cached = ProbeResults.Find(Compiler, LibraryTestQuery);
+			if (Cached.first)
+			{
+				Decide(Cached.second == "1", "Compiler can't compile with its standard library");
+				return;
+			}
+
+			if (Verbose) StandardStream << "Testing standard library of compiler \"" << Compiler << "\".\n" << OutputStream::Flush();
+			bool const FromStandardInput = ReadsStandardInput(Class);
+			if (FromStandardInput) Arguments.push_back("-");
+			else
+			{
+				LibraryExample.reset(new ExampleFile(CXX11Example));
+				Arguments.push_back(LibraryExample->GetPath());
+			}
+			LibraryTest = &Running.Start(Compiler, Arguments);
+			if (FromStandardInput)
+			{
+				try { LibraryTest->In.Write(CXX11Example + "\n"); }
+				catch (InteractionError &Failure)
+				{
+					// The compiler quit without reading the example, so it will report failure
+					if (Verbose) StandardStream << Failure.Explanation << "\n" << OutputStream::Flush();
+				}
+			}
+			LibraryTest->In.Close();
+		}
+
+		FilePath const Compiler;
+		String const Class;
+		std::vector<String> const &RequiredFlags;
+		SubprocessGroup &Running;
+
+		bool Decided, Verdict;
+		CompilerFeatures Features;
+
+		std::vector<String> Dumps; // Empty if the compiler rejected the level
+		std::vector<Subprocess *> Dumpers;
+		unsigned int OutstandingDumps;
+
+		String LibraryTestQuery;
+		std::unique_ptr<ExampleFile> LibraryExample;
+		Subprocess *LibraryTest;
+};
+
 String CXXCompiler::GetIdentifier(void) { return "CXXCompiler"; }
 
 void CXXCompiler::DisplayControllerHelp(void)
 {
 	StandardStream << "\tDiscover." << GetIdentifier() << "{FLAGS...}\n"
-		"\tResult: {Name = COMPILER, Path = PATH}\n"
+		"\tResult: {Name = COMPILER, Path = PATH, Features = {FLAG = SUPPORTED..., Macros = {MACRO = VALUE...}}}\n"
 		"\tLocates a C++ compiler, returning the name in COMPILER and the full path, including executable, in PATH.  FLAGS is a space-separated list of flags that specify requirements for the compiler.\n"
-		"\tFLAGS can include: " << SupportFlags::Generation2011 << "\n"
+		"\tFLAGS can include: " << PrintSupportFlags() << "\n"
 		"\tIf the compiler is recognized, COMPILER will be one of: " << PrintCompilerClasses() << "\n"
+		"\tFor recognized compilers, Features contains every flag in FLAGS with whether the compiler supports it, and Macros contains the compiler's feature-test (__cpp_*), type size (__SIZEOF_*__), and target macros for the newest language level it supports.  Macro VALUEs are strings.\n"
 		"\n";
 }
 
-String const CXX11Example = "#include <functional>\nint main(int argc, char **argv) { std::function<void(void)> a; return 0; }";
-
-void CXXCompiler::Respond(Script &State, HelpItemCollector *HelpItems)
+void CXXCompiler::Respond(QueryState &State, HelpItemCollector *HelpItems)
 {
-	bool RequireCXX11 = GetFlag(State, SupportFlags::Generation2011);
+	std::vector<String> RequiredFlags;
+	for (auto &Level : LanguageLevels)
+		if (GetFlag(State, Level.Flag)) RequiredFlags.push_back(Level.Flag);
+	if (GetFlag(State, SupportFlags::HasInclude)) RequiredFlags.push_back(SupportFlags::HasInclude);
 	ClearArguments(State);
 
 	if (HelpItems != nullptr)
 	{
-		HelpItems->Add(GetIdentifier() + "=PATH", String("Override the detected C++ compiler.") + (RequireCXX11 ? "  The compiler must support C++11." : ""));
+		MemoryStream Requirements;
+		for (auto &Flag : RequiredFlags) Requirements << " " << Flag;
+		HelpItems->Add(GetIdentifier() + "=PATH", String("Override the detected C++ compiler.") + (RequiredFlags.empty() ? String() : "  The compiler must support:" + (String)Requirements + "."));
 		HelpItems->Add(GetIdentifier() + "Class=CLASS", String("Override the detected C++ compiler class.  Standard values of CLASS are: " + PrintCompilerClasses()));
 	}
 
@@ -85,46 +391,29 @@ void CXXCompiler::Respond(Script &State, HelpItemCollector *HelpItems)
 	
 	std::pair<bool, String> OverrideClass = FindConfiguration(GetIdentifier() + "Class");
 
-	auto TestCompiler = [&](FilePath const &Compiler) -> bool
+	struct Candidate
+	{
+		FilePath Compiler;
+		String Name;
+		std::unique_ptr<CompilerProbe> Probe;
+	};
+	std::vector<Candidate> Candidates; // In order of preference
+	SubprocessGroup Running;
+	auto AddCandidate = [&](FilePath const &Compiler)
 	{
-		if (Verbose) StandardStream << "Testing compiler \"" << Compiler << "\".\n" << OutputStream::Flush();
 		String const CompilerFile = OverrideClass.first ? OverrideClass.second : Compiler.File();
-		String Candidate;
-		if ((CompilerFile == (Candidate = Compilers::GXX)) ||
-			(CompilerFile.find("g++") != String::npos))
-		{
-			if (RequireCXX11)
-			{
-				if (Verbose) StandardStream << "Testing compiler for C++11 support.\n" << OutputStream::Flush();
-				if (!CompileExample(Compiler, CXX11Example, {"-x", "c++", "-fsyntax-only", "-std=c++11"}))
-				{
-					if (Verbose) StandardStream << "Compiler doesn't seem to support C++11.\n" << OutputStream::Flush();
-					return false;
-				}
-			}
-		}
-		else 
-		{
-			if (!Compiler.Exists())
-			{
-				if (Verbose) StandardStream << "Overridden compiler doesn't seem to exist.\n" << OutputStream::Flush();
-				return false;
-			}
-			Candidate = CompilerFile;
-		}
-
-		if (Verbose) StandardStream << "Compiler passed all tests.\n" << OutputStream::Flush();
-
-		State.PushString(Candidate);
-		State.PutElement("Name");
-		State.PushString(Compiler.AsAbsoluteString());
-		State.PutElement("Path");
-		return true;
+		String Class;
+		if ((CompilerFile == Compilers::GXX) || (CompilerFile.find("g++") != String::npos))
+			Class = Compilers::GXX;
+		else if (CompilerFile.find(Compilers::Clang) != String::npos)
+			Class = Compilers::Clang;
+		Candidates.push_back(Candidate{Compiler, Class.empty() ? CompilerFile : Class, nullptr});
+		Candidates.back().Probe.reset(new CompilerProbe(Compiler, Class, RequiredFlags, Running));
 	};
 
 	std::pair<bool, String> OverrideCompiler = FindConfiguration(GetIdentifier());
-	if (OverrideCompiler.first && TestCompiler(FilePath::Qualify(OverrideCompiler.second)))
-		return;
+	if (OverrideCompiler.first)
+		AddCandidate(FilePath::Qualify(OverrideCompiler.second));
 	
 	for (auto &ProgramName : std::vector<String>(
 		{
@@ -137,10 +426,70 @@ void CXXCompiler::Respond(Script &State, HelpItemCollector *HelpItems)
 		}))
 	{
 		FilePath *FoundProgram = ProgramInformation->FindProgram(ProgramName);
-		if ((FoundProgram != nullptr) && (TestCompiler(*FoundProgram)))
+		if (FoundProgram != nullptr) AddCandidate(*FoundProgram);
+	}
+
+	// The first candidate in order of preference that passes wins, as soon as every candidate before it has failed
+	while (true)
+	{
+		Candidate *Winner = nullptr;
+		bool Waiting = false;
+		for (auto &Current : Candidates)
+		{
+			if (!Current.Probe->IsDecided())
+			{
+				Waiting = true;
+				break;
+			}
+			if (Current.Probe->Passed())
+			{
+				Winner = &Current;
+				break;
+			}
+		}
+
+		if (Winner != nullptr)
+		{
+			for (auto &Current : Candidates)
+				if (&Current != Winner) Current.Probe->Cancel();
+			Compiler.reset(new FilePath(Winner->Compiler));
+			CompilerName = Winner->Name;
+
+			State.PushString(Winner->Name);
+			State.PutElement("Name");
+			State.PushString(Winner->Compiler.AsAbsoluteString());
+			State.PutElement("Path");
+			CompilerFeatures const *Features = Winner->Probe->GetFeatures();
+			if (Features != nullptr)
+			{
+				State.PushTable();
+				for (auto &Flag : Features->Flags)
+				{
+					State.PushBoolean(Flag.second);
+					State.PutElement(Flag.first);
+				}
+				State.PushTable();
+				for (auto &Macro : Features->Macros)
+				{
+					State.PushString(Macro.second);
+					State.PutElement(Macro.first);
+				}
+				State.PutElement("Macros");
+				State.PutElement("Features");
+			}
 			return;
+		}
+		if (!Waiting) break;
+
+		Subprocess *Done = Running.WaitAny();
+		assert(Done != nullptr);
+		for (auto &Current : Candidates)
+			if (Current.Probe->Consume(*Done)) break;
 	}
 
 	throw InteractionError("Could not find a suitable C++ compiler!  Existing C++ compilers may not support the requested features.  Rerun this program in help mode to see the necessary features.");
 }
 
+FilePath const *CXXCompiler::GetCompiler(void) const { return Compiler.get(); }
+
+String const &CXXCompiler::GetCompilerName(void) const { return CompilerName; }
@@ -3,6 +3,8 @@
 #endif
 #define CXXCOMPILER_H
 
+#include <memory>
+
 #include "../information.h"
 
 class CXXCompiler
@@ -10,6 +12,13 @@ class CXXCompiler
 	public:
 		static String GetIdentifier(void);
 		static void DisplayControllerHelp(void);
-		void Respond(Script &State, HelpItemCollector *HelpItems);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+		FilePath const *GetCompiler(void) const; // The compiler found by the most recent discovery, nullptr before one is found
+		static bool const AnswersChangeState = true; // Because of GetCompiler
+		String const &GetCompilerName(void) const;
+
+	private:
+		std::unique_ptr<FilePath> Compiler;
+		String CompilerName;
 };
 
@@ -0,0 +1,229 @@
+#include "filesystemcapabilities.h"
+
+#include <fstream>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifndef WINDOWS
+#include <sys/statvfs.h>
+#endif
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/vfs.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#endif
+
+#include "../shared.h"
+#include "../configuration.h"
+
+extern bool Verbose;
+
+#ifdef __linux__
+// Finds the filesystem type of the mount with Device in /proc/self/mountinfo
+static bool FindMount(unsigned long long Device, String &Type)
+{
+	std::ifstream Input("/proc/self/mountinfo");
+	String Line;
+	MemoryStream Expected;
+	Expected << major(Device) << ":" << minor(Device);
+	while (std::getline(Input, Line))
+	{
+		// ID PARENT MAJOR:MINOR ROOT MOUNTPOINT OPTIONS [OPTIONAL...] - TYPE SOURCE SUPEROPTIONS
+		std::queue<String> Fields = StringSplitter({' '}, true).Process(Line).Results();
+		std::vector<String> Parts;
+		for (; !Fields.empty(); Fields.pop()) Parts.push_back(Fields.front());
+		if ((Parts.size() < 6) || (Parts[2] != (String)Expected)) continue;
+		for (size_t Index = 6; Index + 1 < Parts.size(); ++Index)
+			if (Parts[Index] == "-")
+			{
+				Type = Parts[Index + 1];
+				return true;
+			}
+	}
+	return false;
+}
+
+class ScratchFile
+{
+	public:
+		ScratchFile(DirectoryPath const &Directory) : Path(Directory.AsAbsoluteString() + "/.selfdiscovery-XXXXXX")
+		{
+			std::vector<char> Template(Path.begin(), Path.end());
+			Template.push_back('\0');
+			Descriptor = mkstemp(Template.data());
+			Path = Template.data();
+		}
+		~ScratchFile(void)
+		{
+			if (Descriptor == -1) return;
+			close(Descriptor);
+			unlink(Path.c_str());
+		}
+		int GetDescriptor(void) const { return Descriptor; }
+
+	private:
+		String Path;
+		int Descriptor;
+};
+
+size_t const ScratchSize = 64 * 1024;
+
+// Makes a source file with a few blocks of data, so copies have something to clone
+static bool FillScratch(ScratchFile const &Source)
+{
+	if (Source.GetDescriptor() == -1) return false;
+	std::vector<char> const Data(ScratchSize, 'x');
+	return (write(Source.GetDescriptor(), Data.data(), Data.size()) == (ssize_t)Data.size()) && (fsync(Source.GetDescriptor()) == 0);
+}
+
+static bool TestCopyFileRange(ScratchFile const &Source, DirectoryPath const &Destination)
+{
+	ScratchFile Target(Destination);
+	if (Target.GetDescriptor() == -1) return false;
+	loff_t SourceOffset = 0, TargetOffset = 0;
+	return syscall(__NR_copy_file_range, Source.GetDescriptor(), &SourceOffset, Target.GetDescriptor(), &TargetOffset, ScratchSize, 0) == (long)ScratchSize;
+}
+#endif
+
+String FilesystemCapabilities::GetIdentifier(void) { return "Filesystem"; }
+
+void FilesystemCapabilities::DisplayControllerHelp(void)
+{
+	StandardStream << "\tDiscover." << GetIdentifier() << "{Path = PATH, Destination = DESTINATION}\n"
+		"\tResult: {Directory = DIRECTORY, Device = DEVICE, Type = TYPE, FreeBytes = FREE, TotalBytes = TOTAL, ReadOnly = READONLY, Writable = WRITABLE, Atime = ATIME, Reflink = REFLINK, CopyFileRange = COPY, CopyFileRangeToDestination = DESTINATIONCOPY}\n"
+		"\tDescribes the filesystem holding directory PATH, or holding its nearest existing parent, DIRECTORY, if PATH doesn't exist yet.  DEVICE is the device id, like 8:1.  TYPE is the filesystem type, like ext4, btrfs, xfs, tmpfs, overlay, or nfs.  FREE is the number of bytes available to unprivileged users, and TOTAL is the size of the filesystem in bytes.  ATIME is noatime, relatime, or strictatime depending on how access times are updated.\n"
+		"\tREFLINK is true if files in DIRECTORY can be cloned with FICLONE, and COPY is true if copy_file_range works within it.  If DESTINATION is specified, DESTINATIONCOPY is true if copy_file_range works from DIRECTORY to DESTINATION (or its nearest existing parent).  These are tested with scratch files, so they are false if the directories aren't writable.  The tests are run once per device.\n"
+		"\n";
+}
+
+void FilesystemCapabilities::Respond(QueryState &State, HelpItemCollector *HelpItems)
+{
+	String const PathArgument = GetArgument(State, "Path");
+	String const DestinationArgument = GetOptionalArgument(State, "Destination");
+	ClearArguments(State);
+
+	if (HelpItems != nullptr)
+	{
+		HelpItems->Add(GetIdentifier() + "Reflink=SUPPORTED", "Overrides whether reflinks work.  SUPPORTED is true or false.");
+		HelpItems->Add(GetIdentifier() + "CopyFileRange=SUPPORTED", "Overrides whether copy_file_range works.  SUPPORTED is true or false.");
+	}
+	std::pair<bool, String> OverrideReflink = FindConfiguration(GetIdentifier() + "Reflink"),
+		OverrideCopyFileRange = FindConfiguration(GetIdentifier() + "CopyFileRange");
+
+	DirectoryPath const Directory = FindExistingAncestor(DirectoryPath::Qualify(PathArgument));
+	String const DirectoryString = Directory.AsAbsoluteString();
+
+	// Without test results, like when the directory isn't writable, the capabilities are false unless overridden
+	auto PushCapabilities = [&](bool Reflink, bool CopyFileRange)
+	{
+		State.PushBoolean(OverrideReflink.first ? (OverrideReflink.second == "true") : Reflink);
+		State.PutElement("Reflink");
+		State.PushBoolean(OverrideCopyFileRange.first ? (OverrideCopyFileRange.second == "true") : CopyFileRange);
+		State.PutElement("CopyFileRange");
+	};
+
+	State.PushTable();
+	State.PushString(DirectoryString);
+	State.PutElement("Directory");
+
+	struct stat Status;
+	if (stat(DirectoryString.c_str(), &Status) != 0)
+	{
+		if (Verbose) StandardStream << "Couldn't examine \"" << DirectoryString << "\".\n" << OutputStream::Flush();
+		PushCapabilities(false, false);
+		return;
+	}
+	unsigned long long const Device = Status.st_dev;
+	bool const Writable = access(DirectoryString.c_str(), W_OK) == 0;
+	State.PushBoolean(Writable);
+	State.PutElement("Writable");
+
+#ifndef WINDOWS
+	struct statvfs Space;
+	if (statvfs(DirectoryString.c_str(), &Space) == 0)
+	{
+		State.PushInteger(static_cast<unsigned long long>(Space.f_bavail) * Space.f_frsize);
+		State.PutElement("FreeBytes");
+		State.PushInteger(static_cast<unsigned long long>(Space.f_blocks) * Space.f_frsize);
+		State.PutElement("TotalBytes");
+		State.PushBoolean((Space.f_flag & ST_RDONLY) != 0);
+		State.PutElement("ReadOnly");
+#ifdef ST_NOATIME
+		State.PushString((Space.f_flag & ST_NOATIME) ? "noatime" : (Space.f_flag & ST_RELATIME) ? "relatime" : "strictatime");
+		State.PutElement("Atime");
+#endif
+	}
+#endif
+
+	bool Reflink = false, CopyFileRange = false; // As tested
+#ifdef __linux__
+	{
+		State.PushString(MemoryStream() << major(Device) << ":" << minor(Device));
+		State.PutElement("Device");
+		String Type;
+		if (!FindMount(Device, Type))
+		{
+			// Mounts from other namespaces aren't listed, so fall back on the raw filesystem magic number
+			struct statfs Filesystem;
+			if (statfs(DirectoryString.c_str(), &Filesystem) == 0)
+			{
+				char Magic[20];
+				snprintf(Magic, sizeof(Magic), "0x%lx", static_cast<unsigned long>(Filesystem.f_type));
+				Type = Magic;
+			}
+		}
+		if (!Type.empty())
+		{
+			State.PushString(Type);
+			State.PutElement("Type");
+		}
+	}
+
+	auto Known = Devices.find(Device);
+	if ((Known == Devices.end()) && Writable)
+	{
+		ScratchFile Source(Directory);
+		if (FillScratch(Source))
+		{
+			Tests Results;
+			ScratchFile Clone(Directory);
+			Results.Reflink = (Clone.GetDescriptor() != -1) && (ioctl(Clone.GetDescriptor(), FICLONE, Source.GetDescriptor()) == 0);
+			Results.CopyFileRange = TestCopyFileRange(Source, Directory);
+			if (Verbose) StandardStream << "Filesystem of \"" << DirectoryString << "\" " << (Results.Reflink ? "supports" : "doesn't support") << " reflinks and " << (Results.CopyFileRange ? "supports" : "doesn't support") << " copy_file_range.\n" << OutputStream::Flush();
+			Known = Devices.insert(std::make_pair(Device, Results)).first;
+		}
+	}
+	if (Known != Devices.end())
+	{
+		Reflink = Known->second.Reflink;
+		CopyFileRange = Known->second.CopyFileRange;
+	}
+
+	if (!DestinationArgument.empty())
+	{
+		DirectoryPath const Destination = FindExistingAncestor(DirectoryPath::Qualify(DestinationArgument));
+		struct stat DestinationStatus;
+		if ((stat(Destination.AsAbsoluteString().c_str(), &DestinationStatus) == 0) && Writable && (access(Destination.AsAbsoluteString().c_str(), W_OK) == 0))
+		{
+			std::pair<unsigned long long, unsigned long long> const Pair(Device, DestinationStatus.st_dev);
+			auto KnownCopy = CrossDeviceCopies.find(Pair);
+			if (KnownCopy == CrossDeviceCopies.end())
+			{
+				ScratchFile Source(Directory);
+				bool const Works = FillScratch(Source) && TestCopyFileRange(Source, Destination);
+				if (Verbose) StandardStream << "copy_file_range " << (Works ? "works" : "doesn't work") << " from \"" << DirectoryString << "\" to \"" << Destination.AsAbsoluteString() << "\".\n" << OutputStream::Flush();
+				KnownCopy = CrossDeviceCopies.insert(std::make_pair(Pair, Works)).first;
+			}
+			State.PushBoolean(OverrideCopyFileRange.first ? (OverrideCopyFileRange.second == "true") : KnownCopy->second);
+			State.PutElement("CopyFileRangeToDestination");
+		}
+	}
+#endif
+	PushCapabilities(Reflink, CopyFileRange);
+}
+
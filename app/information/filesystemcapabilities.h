@@ -0,0 +1,25 @@
+#ifndef FILESYSTEMCAPABILITIES_H
+#define FILESYSTEMCAPABILITIES_H
+
+#include <map>
+
+#include "../information.h"
+
+class FilesystemCapabilities
+{
+	public:
+		static String GetIdentifier(void);
+		static void DisplayControllerHelp(void);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+		static bool const AnswersVaryBetweenRuns = true; // Because of free space and mounts
+
+	private:
+		struct Tests
+		{
+			bool Reflink, CopyFileRange;
+		};
+		std::map<unsigned long long, Tests> Devices; // Copy tests by device id, once one has been run on the device
+		std::map<std::pair<unsigned long long, unsigned long long>, bool> CrossDeviceCopies; // Whether copy_file_range works from the first device to the second
+};
+
+#endif // FILESYSTEMCAPABILITIES_H
@@ -14,7 +14,7 @@ void Flag::DisplayControllerHelp(void)
 		"\tDescribes a flag a user may specify on the configuration command line.  If the user specifies the flag, PRESENT is \"true\", otherwise \"false\".  If the user specifies the flag in the form NAME=VALUE, VALUE will also be returned.  If HASVALUE is specified as true, the user help will indicate that this flag should receive a value.\n\n";
 }
 
-void Flag::Respond(Script &State, HelpItemCollector *HelpItems)
+void Flag::Respond(QueryState &State, HelpItemCollector *HelpItems)
 {
 	String FlagName = GetArgument(State, "Name");
 	if (HelpItems != nullptr) 
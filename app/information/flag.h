@@ -8,7 +8,7 @@ class Flag
 	public:
 		static String GetIdentifier(void);
 		static void DisplayControllerHelp(void);
-		void Respond(Script &State, HelpItemCollector *HelpItems);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
 };
 
 #endif // FLAG_H
@@ -0,0 +1,191 @@
+#include "kernel.h"
+
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#if __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#endif
+#endif
+
+#include "../shared.h"
+#include "../configuration.h"
+
+extern bool Verbose;
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(IO_URING_OP_SUPPORTED)
+// io_uring opcode numbers are fixed by the kernel ABI; opcodes newer than this list are reported by number
+static char const *const IOUringOperationNames[] =
+{
+	"NOP", "READV", "WRITEV", "FSYNC", "READ_FIXED", "WRITE_FIXED", "POLL_ADD", "POLL_REMOVE",
+	"SYNC_FILE_RANGE", "SENDMSG", "RECVMSG", "TIMEOUT", "TIMEOUT_REMOVE", "ACCEPT", "ASYNC_CANCEL", "LINK_TIMEOUT",
+	"CONNECT", "FALLOCATE", "OPENAT", "CLOSE", "FILES_UPDATE", "STATX", "READ", "WRITE",
+	"FADVISE", "MADVISE", "SEND", "RECV", "OPENAT2", "EPOLL_CTL", "SPLICE", "PROVIDE_BUFFERS",
+	"REMOVE_BUFFERS", "TEE", "SHUTDOWN", "RENAMEAT", "UNLINKAT", "MKDIRAT", "SYMLINKAT", "LINKAT",
+	"MSG_RING", "FSETXATTR", "SETXATTR", "FGETXATTR", "GETXATTR", "SOCKET", "URING_CMD", "SEND_ZC",
+	"SENDMSG_ZC", "READ_MULTISHOT", "WAITID", "FUTEX_WAIT", "FUTEX_WAKE", "FUTEX_WAITV", "FIXED_FD_INSTALL", "FTRUNCATE",
+	"BIND", "LISTEN"
+};
+#endif
+
+Kernel::Kernel(void)
+{
+	// Each test makes the real system call, since seccomp filters and vendor backports make kernel versions meaningless
+	// Failure is the errno of the failed call; capabilities this build can't test are recorded with ENOSYS
+	auto Record = [&](String const &Name, bool Supported, int Failure)
+	{
+		Capabilities.push_back(Capability{Name, Supported, Supported ? String() : String(strerror(Failure))});
+		if (Verbose) StandardStream << "System call " << Name << (Supported ? " works" : " failed: " + Capabilities.back().Failure) << ".\n" << OutputStream::Flush();
+	};
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(IO_URING_OP_SUPPORTED)
+	{
+		io_uring_params Parameters;
+		memset(&Parameters, 0, sizeof(Parameters));
+		int const Ring = syscall(__NR_io_uring_setup, 1, &Parameters);
+		Record("IOUring", Ring != -1, errno);
+		if (Ring != -1)
+		{
+			std::vector<char> ProbeBuffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+			io_uring_probe *Supported = reinterpret_cast<io_uring_probe *>(ProbeBuffer.data());
+			if (syscall(__NR_io_uring_register, Ring, IORING_REGISTER_PROBE, Supported, 256) != -1)
+			{
+				for (unsigned int Operation = 0; (Operation <= Supported->last_op) && (Operation < 256); ++Operation)
+				{
+					if (!(Supported->ops[Operation].flags & IO_URING_OP_SUPPORTED)) continue;
+					if (Operation < sizeof(IOUringOperationNames) / sizeof(IOUringOperationNames[0])) IOUringOperations.push_back(IOUringOperationNames[Operation]);
+					else IOUringOperations.push_back(MemoryStream() << "OP" << Operation);
+				}
+			}
+			else if (Verbose) StandardStream << "io_uring works but can't list its operations: " << strerror(errno) << "\n" << OutputStream::Flush();
+			close(Ring);
+		}
+	}
+#else
+	Record("IOUring", false, ENOSYS);
+#endif
+
+#if defined(__linux__) && defined(SYS_memfd_create)
+	{
+		int const Memory = syscall(SYS_memfd_create, "selfdiscovery-kernel", 1 /* MFD_CLOEXEC */);
+		Record("MemfdCreate", Memory != -1, errno);
+		if (Memory != -1) close(Memory);
+	}
+#else
+	Record("MemfdCreate", false, ENOSYS);
+#endif
+
+#if defined(__linux__) && defined(__NR_pidfd_open)
+	{
+		int const Process = syscall(__NR_pidfd_open, getpid(), 0);
+		Record("PidfdOpen", Process != -1, errno);
+		if (Process != -1) close(Process);
+	}
+#else
+	Record("PidfdOpen", false, ENOSYS);
+#endif
+
+#if defined(__linux__) && defined(__NR_copy_file_range)
+	{
+		// Between two anonymous temporary files, so the copy stays within one filesystem
+		FILE *Source = tmpfile(), *Target = tmpfile();
+		bool Works = false;
+		if ((Source != nullptr) && (Target != nullptr))
+		{
+			char const Data[] = "selfdiscovery";
+			if (write(fileno(Source), Data, sizeof(Data)) == (ssize_t)sizeof(Data))
+			{
+				loff_t SourceOffset = 0, TargetOffset = 0;
+				Works = syscall(__NR_copy_file_range, fileno(Source), &SourceOffset, fileno(Target), &TargetOffset, sizeof(Data), 0) == (long)sizeof(Data);
+			}
+		}
+		Record("CopyFileRange", Works, errno);
+		if (Source != nullptr) fclose(Source);
+		if (Target != nullptr) fclose(Target);
+	}
+#else
+	Record("CopyFileRange", false, ENOSYS);
+#endif
+
+#if defined(__linux__) && defined(__NR_statx) && defined(STATX_BASIC_STATS)
+	{
+		struct statx Status;
+		Record("Statx", syscall(__NR_statx, AT_FDCWD, "/", AT_STATX_SYNC_AS_STAT, STATX_BASIC_STATS, &Status) == 0, errno);
+	}
+#else
+	Record("Statx", false, ENOSYS);
+#endif
+
+#if defined(__linux__) && defined(__NR_openat2) && defined(RESOLVE_NO_SYMLINKS)
+	{
+		open_how How;
+		memset(&How, 0, sizeof(How));
+		How.flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+		How.resolve = RESOLVE_NO_MAGICLINKS;
+		int const Directory = syscall(__NR_openat2, AT_FDCWD, "/", &How, sizeof(How));
+		Record("Openat2", Directory != -1, errno);
+		if (Directory != -1) close(Directory);
+	}
+#else
+	Record("Openat2", false, ENOSYS);
+#endif
+
+	for (auto &Current : Capabilities)
+	{
+		std::pair<bool, String> Override = FindConfiguration(GetIdentifier() + Current.Name);
+		if (!Override.first) continue;
+		if (Verbose) StandardStream << "Found " << Current.Name << " support by configuration.\n" << OutputStream::Flush();
+		Current.Supported = Override.second == "true";
+		Current.Failure = Current.Supported ? String() : String("Disabled by configuration");
+		if ((Current.Name == "IOUring") && !Current.Supported) IOUringOperations.clear();
+	}
+}
+
+String Kernel::GetIdentifier(void) { return "Kernel"; }
+
+void Kernel::DisplayControllerHelp(void)
+{
+	StandardStream << "\tDiscover." << GetIdentifier() << "{}\n"
+		"\tResult: {IOUring = SUPPORTED, IOUringOperations = {OPERATION...}, MemfdCreate = SUPPORTED, PidfdOpen = SUPPORTED, CopyFileRange = SUPPORTED, Statx = SUPPORTED, Openat2 = SUPPORTED, Failures = {CAPABILITY = REASON...}}\n"
+		"\tTests which Linux system calls work for processes run like this one, by calling each of them.  This accounts for seccomp filters, sysctls like kernel.io_uring_disabled, and backported features, which kernel versions don't.  OPERATION is the name of an io_uring opcode the kernel supports without the IORING_OP_ prefix, like READ or STATX, or OPn for opcodes newer than this program.  Failures has the error for each capability that didn't work.  Everything is unsupported on other systems.\n"
+		"\n";
+}
+
+void Kernel::Respond(QueryState &State, HelpItemCollector *HelpItems)
+{
+	ClearArguments(State);
+	if (HelpItems != nullptr)
+		for (auto &Current : Capabilities)
+			HelpItems->Add(GetIdentifier() + Current.Name + "=SUPPORTED", "Overrides whether " + Current.Name + " works.  SUPPORTED is true or false.");
+
+	State.PushTable();
+	for (auto &Current : Capabilities)
+	{
+		State.PushBoolean(Current.Supported);
+		State.PutElement(Current.Name);
+	}
+	State.PushTable();
+	for (unsigned int Index = 1; Index <= IOUringOperations.size(); ++Index)
+	{
+		State.PushString(IOUringOperations[Index - 1]);
+		State.PutElement(Index);
+	}
+	State.PutElement("IOUringOperations");
+	State.PushTable();
+	for (auto &Current : Capabilities)
+	{
+		if (Current.Supported) continue;
+		State.PushString(Current.Failure);
+		State.PutElement(Current.Name);
+	}
+	State.PutElement("Failures");
+}
+
@@ -0,0 +1,26 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "../information.h"
+
+class Kernel
+{
+	public:
+		Kernel(void);
+		static String GetIdentifier(void);
+		static void DisplayControllerHelp(void);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+		static bool const AnswersVaryBetweenRuns = true; // Because of seccomp filters and sysctls
+
+	private:
+		struct Capability
+		{
+			String Name;
+			bool Supported;
+			String Failure; // Why the system call failed, empty if it worked
+		};
+		std::vector<Capability> Capabilities;
+		std::vector<String> IOUringOperations; // Supported io_uring opcodes, by name
+};
+
+#endif // KERNEL_H
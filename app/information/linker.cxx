@@ -0,0 +1,291 @@
+#include "linker.h"
+
+#include <chrono>
+#include <cstdlib>
+
+#include "../shared.h"
+#include "../configuration.h"
+#include "../subprocess.h"
+#include "../probecache.h"
+#include "program.h"
+#include "cxxcompiler.h"
+
+extern Information::AnchorImplementation<Program> ProgramInformation;
+extern Information::AnchorImplementation<CXXCompiler> CXXCompilerInformation;
+extern ProbeCache ProbeResults;
+extern bool Verbose;
+
+struct LinkerKind
+{
+	String const Name;
+	std::vector<String> const Programs; // Any of these names means the linker is installed
+	String const Flag;
+};
+
+// In order of preference when not benchmarking, which is roughly fastest first
+static std::vector<LinkerKind> const LinkerKinds
+{
+	{"mold", {"mold", "ld.mold"}, "-fuse-ld=mold"},
+	{"lld", {"ld.lld", "lld"}, "-fuse-ld=lld"},
+	{"gold", {"ld.gold"}, "-fuse-ld=gold"},
+	{"bfd", {"ld.bfd"}, "-fuse-ld=bfd"}
+};
+
+String const LinkExample = "#include <string>\nint main(int argc, char **argv) { return std::string(argv[0]).empty(); }";
+
+unsigned int const BenchmarkObjects = 32, BenchmarkFunctions = 200, BenchmarkRepetitions = 3;
+
+// Object Index defines BenchmarkFunctions functions and an entry point that uses them all; object 0 also has main, which calls every entry point
+static String GenerateBenchmarkSource(unsigned int Index)
+{
+	MemoryStream Out;
+	for (unsigned int Function = 0; Function < BenchmarkFunctions; ++Function)
+		Out << "int Function" << Index << "_" << Function << "(int Value) { return Value * " << Function << " + " << Index << "; }\n";
+	Out << "int Entry" << Index << "(int Value)\n{\n";
+	for (unsigned int Function = 0; Function < BenchmarkFunctions; ++Function)
+		Out << "\tValue = Function" << Index << "_" << Function << "(Value);\n";
+	Out << "\treturn Value;\n}\n";
+	if (Index == 0)
+	{
+		for (unsigned int Other = 1; Other < BenchmarkObjects; ++Other) Out << "int Entry" << Other << "(int Value);\n";
+		Out << "int main(int argc, char **argv)\n{\n\tint Value = argc;\n";
+		for (unsigned int Other = 0; Other < BenchmarkObjects; ++Other) Out << "\tValue = Entry" << Other << "(Value);\n";
+		Out << "\treturn Value == 0;\n}\n";
+	}
+	return Out;
+}
+
+static FilePath CreateOutputPath(void)
+{
+	return std::get<0>(CreateTemporaryFile(LocateTemporaryDirectory()));
+}
+
+String Linker::GetIdentifier(void) { return "Linker"; }
+
+void Linker::DisplayControllerHelp(void)
+{
+	StandardStream << "\tDiscover." << GetIdentifier() << "{Compiler = PATH, Benchmark = BENCHMARK}\n"
+		"\tResult: {Name = NAME, Path = LINKERPATH, Flags = {FLAG...}, Linkers = {{Name = NAME, Path = LINKERPATH, Works = WORKS, Microseconds = TIME}...}}\n"
+		"\tFinds the installed linkers (mold, lld, gold, and bfd) and tests whether each one can link a small program when selected with -fuse-ld.  Linking uses the compiler at PATH, or the compiler found by the most recent Discover.CXXCompiler if PATH is omitted.  NAME is the preferred working linker, and FLAGS are the compiler flags that select it.  If no linker works with -fuse-ld, NAME is default, FLAGS is empty, and the compiler links with its own default linker.\n"
+		"\tIf BENCHMARK is true, every working linker also links a generated program of " << BenchmarkObjects << " objects, and the fastest is preferred.  TIME is its fastest link in microseconds.  Otherwise linkers are preferred in this order: mold, lld, gold, bfd.\n"
+		"\tLinkers lists every installed linker.  Results are remembered until the compiler or linker changes.\n"
+		"\n";
+}
+
+void Linker::Respond(QueryState &State, HelpItemCollector *HelpItems)
+{
+	String const CompilerArgument = GetOptionalArgument(State, "Compiler");
+	bool const Benchmark = GetFlag(State, "Benchmark");
+	ClearArguments(State);
+
+	if (HelpItems != nullptr)
+	{
+		MemoryStream Names;
+		for (auto &Kind : LinkerKinds) Names << Kind.Name << ", ";
+		Names << "default";
+		HelpItems->Add(GetIdentifier() + "=NAME", "Overrides the chosen linker without testing it.  NAME is one of: " + (String)Names + ".");
+	}
+
+	State.PushTable();
+
+	std::pair<bool, String> OverrideLinker = FindConfiguration(GetIdentifier());
+	if (OverrideLinker.first)
+	{
+		if (Verbose) StandardStream << "Using linker \"" << OverrideLinker.second << "\" specified by configuration.\n" << OutputStream::Flush();
+		State.PushString(OverrideLinker.second);
+		State.PutElement("Name");
+		State.PushTable();
+		if (OverrideLinker.second != "default")
+		{
+			State.PushString("-fuse-ld=" + OverrideLinker.second);
+			State.PutElement(1);
+		}
+		State.PutElement("Flags");
+		return;
+	}
+
+	if (CompilerArgument.empty() && (CXXCompilerInformation->GetCompiler() == nullptr))
+		throw Error::Input("Discover." + GetIdentifier() + " needs a compiler.  Call Discover.CXXCompiler first or pass Compiler.");
+	FilePath const Compiler = !CompilerArgument.empty() ? FilePath::Qualify(CompilerArgument) : *CXXCompilerInformation->GetCompiler();
+
+	struct Candidate
+	{
+		LinkerKind const &Kind;
+		FilePath Path;
+		String Query; // Identifies the compiler, linker, and test for caching
+		Result Outcome;
+		bool Decided, Timed;
+	};
+	std::vector<Candidate> Candidates;
+	for (auto &Kind : LinkerKinds)
+		for (auto &ProgramName : Kind.Programs)
+		{
+			FilePath *Found = ProgramInformation->FindProgram(ProgramName);
+			if (Found == nullptr) continue;
+			// The compiler chooses the linker program itself, so the found program stands in for it in the fingerprint
+			Candidates.push_back(Candidate{Kind, *Found, Kind.Flag + " " + HashString(FingerprintFile(*Found) + LinkExample), Result{false, 0}, false, false});
+			break;
+		}
+	if (Verbose && Candidates.empty()) StandardStream << "No alternative linkers are installed.\n" << OutputStream::Flush();
+
+	// Results from earlier in this run, then from earlier runs
+	for (auto &Current : Candidates)
+	{
+		auto Known = Results.find(Compiler.AsAbsoluteString() + "\t" + Current.Query);
+		if (Known != Results.end())
+		{
+			Current.Outcome = Known->second;
+			Current.Decided = true;
+		}
+		else
+		{
+			std::pair<bool, String> Cached = ProbeResults.Find(Compiler, "link " + Current.Query);
+			if (!Cached.first) continue;
+			Current.Outcome.Works = Cached.second == "1";
+			Current.Decided = true;
+		}
+		Current.Timed = !Current.Outcome.Works || (Current.Outcome.Microseconds != 0);
+		if (Benchmark && !Current.Timed)
+		{
+			std::pair<bool, String> CachedTime = ProbeResults.Find(Compiler, "benchmark " + Current.Query);
+			if (!CachedTime.first) continue;
+			Current.Outcome.Microseconds = strtoull(CachedTime.second.c_str(), nullptr, 10);
+			Current.Timed = true;
+		}
+	}
+
+	// Test every undecided linker at once
+	{
+		SubprocessGroup Running;
+		std::vector<std::pair<Candidate *, Subprocess *> > Tests;
+		std::vector<FilePath> Outputs;
+		for (auto &Current : Candidates)
+		{
+			if (Current.Decided) continue;
+			if (Verbose) StandardStream << "Testing linker \"" << Current.Path << "\" with compiler \"" << Compiler << "\".\n" << OutputStream::Flush();
+			Outputs.push_back(CreateOutputPath());
+			Subprocess &Test = Running.Start(Compiler, {"-x", "c++", "-", "-x", "none", "-o", Outputs.back().AsAbsoluteString(), Current.Kind.Flag});
+			try { Test.In.Write(LinkExample + "\n"); }
+			catch (InteractionError &Failure)
+			{
+				// The compiler quit without reading the example, so it will report failure
+				if (Verbose) StandardStream << Failure.Explanation << "\n" << OutputStream::Flush();
+			}
+			Test.In.Close();
+			Tests.push_back(std::make_pair(&Current, &Test));
+		}
+		Running.WaitAll();
+		for (auto &Test : Tests)
+		{
+			Candidate &Current = *Test.first;
+			String const Errors = Test.second->Error.ReadAll();
+			Current.Outcome.Works = Test.second->GetResult() == 0;
+			Current.Decided = true;
+			Current.Timed = !Current.Outcome.Works;
+			if (Verbose) StandardStream << "Linker \"" << Current.Path << "\" " << (Current.Outcome.Works ? "works" : "doesn't work") << " with compiler \"" << Compiler << "\".\n" << (Current.Outcome.Works ? String() : Errors) << OutputStream::Flush();
+			ProbeResults.Store(Compiler, "link " + Current.Query, Current.Outcome.Works ? "1" : "0");
+		}
+		for (auto &Output : Outputs) Output.Delete();
+	}
+
+	if (Benchmark)
+	{
+		bool NeedsTiming = false;
+		for (auto &Current : Candidates) if (!Current.Timed) NeedsTiming = true;
+		if (NeedsTiming)
+		{
+			// Compile the generated objects once, all at once, then time each linker on them alone
+			SubprocessGroup Running;
+			std::vector<FilePath> Objects;
+			bool Compiled = true;
+			for (unsigned int Index = 0; Index < BenchmarkObjects; ++Index)
+			{
+				Objects.push_back(CreateOutputPath());
+				Subprocess &Compile = Running.Start(Compiler, {"-x", "c++", "-c", "-O0", "-o", Objects.back().AsAbsoluteString(), "-"});
+				try { Compile.In.Write(GenerateBenchmarkSource(Index)); }
+				catch (InteractionError &Failure) { if (Verbose) StandardStream << Failure.Explanation << "\n" << OutputStream::Flush(); }
+				Compile.In.Close();
+			}
+			for (Subprocess *Done = Running.WaitAny(); Done != nullptr; Done = Running.WaitAny())
+				if (Done->GetResult() != 0) Compiled = false;
+			if (!Compiled && Verbose) StandardStream << "Couldn't compile the linker benchmark; linkers won't be timed.\n" << OutputStream::Flush();
+
+			FilePath Output = CreateOutputPath();
+			for (auto &Current : Candidates)
+			{
+				if (!Compiled || Current.Timed) continue;
+				std::vector<String> Arguments({"-o", Output.AsAbsoluteString(), Current.Kind.Flag});
+				for (auto &Object : Objects) Arguments.push_back(Object.AsAbsoluteString());
+				unsigned long long Fastest = 0;
+				for (unsigned int Repetition = 0; Repetition < BenchmarkRepetitions; ++Repetition)
+				{
+					auto const Start = std::chrono::steady_clock::now();
+					Running.Start(Compiler, Arguments).In.Close();
+					Subprocess *Done = Running.WaitAny();
+					unsigned long long const Elapsed = std::max<long long>(1, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start).count());
+					if ((Done == nullptr) || (Done->GetResult() != 0))
+					{
+						Fastest = 0;
+						break;
+					}
+					if ((Fastest == 0) || (Elapsed < Fastest)) Fastest = Elapsed;
+				}
+				if (Verbose) StandardStream << "Linker \"" << Current.Path << "\" took " << Fastest << " microseconds to link the benchmark.\n" << OutputStream::Flush();
+				if (Fastest == 0) continue; // Linked the example but not the benchmark, so don't remember anything
+				Current.Outcome.Microseconds = Fastest;
+				Current.Timed = true;
+				ProbeResults.Store(Compiler, "benchmark " + Current.Query, AsString(Fastest));
+			}
+			Output.Delete();
+			for (auto &Object : Objects) Object.Delete();
+		}
+	}
+
+	Candidate const *Chosen = nullptr;
+	for (auto &Current : Candidates)
+	{
+		Results[Compiler.AsAbsoluteString() + "\t" + Current.Query] = Current.Outcome;
+		if (!Current.Outcome.Works) continue;
+		if (Chosen == nullptr) Chosen = &Current;
+		else if (Benchmark && (Current.Outcome.Microseconds != 0) &&
+			((Chosen->Outcome.Microseconds == 0) || (Current.Outcome.Microseconds < Chosen->Outcome.Microseconds)))
+			Chosen = &Current;
+	}
+	if (Verbose) StandardStream << "Chose linker " << ((Chosen == nullptr) ? String("default") : Chosen->Kind.Name) << ".\n" << OutputStream::Flush();
+
+	State.PushString((Chosen == nullptr) ? String("default") : Chosen->Kind.Name);
+	State.PutElement("Name");
+	if (Chosen != nullptr)
+	{
+		State.PushString(Chosen->Path.AsAbsoluteString());
+		State.PutElement("Path");
+	}
+	State.PushTable();
+	if (Chosen != nullptr)
+	{
+		State.PushString(Chosen->Kind.Flag);
+		State.PutElement(1);
+	}
+	State.PutElement("Flags");
+
+	State.PushTable();
+	for (unsigned int Index = 1; Index <= Candidates.size(); ++Index)
+	{
+		Candidate const &Current = Candidates[Index - 1];
+		State.PushTable();
+		State.PushString(Current.Kind.Name);
+		State.PutElement("Name");
+		State.PushString(Current.Path.AsAbsoluteString());
+		State.PutElement("Path");
+		State.PushBoolean(Current.Outcome.Works);
+		State.PutElement("Works");
+		if (Current.Outcome.Microseconds != 0)
+		{
+			State.PushInteger(Current.Outcome.Microseconds);
+			State.PutElement("Microseconds");
+		}
+		State.PutElement(Index);
+	}
+	State.PutElement("Linkers");
+}
+
@@ -0,0 +1,24 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include <map>
+
+#include "../information.h"
+
+class Linker
+{
+	public:
+		static String GetIdentifier(void);
+		static void DisplayControllerHelp(void);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+
+	private:
+		struct Result
+		{
+			bool Works;
+			unsigned long long Microseconds; // Fastest benchmark link, 0 if not benchmarked
+		};
+		std::map<String, Result> Results; // By compiler and linker, for this run
+};
+
+#endif // LINKER_H
@@ -15,7 +15,7 @@ extern bool Verbose;
 extern Information::AnchorImplementation<Platform> PlatformInformation;
 
 #ifdef _WIN32
-static void DumpProjectInstallDirectory(Script &State, String const &Project)
+static void DumpProjectInstallDirectory(QueryState &State, String const &Project)
 {
 	wchar_t PathResult[MAX_PATH];
 	HRESULT Result = SHGetFolderPathW(nullptr, CSIDL_PROGRAM_FILES, nullptr, 0, PathResult);
@@ -27,7 +27,7 @@ static void DumpProjectInstallDirectory(Script &State, String const &Project)
 }
 #endif
 
-void ReturnLocation(Script &State, String const &Location)
+void ReturnLocation(QueryState &State, String const &Location)
 {
 	State.PushTable();
 	State.PushString(Location);
@@ -44,7 +44,7 @@ void InstallExecutableDirectory::DisplayControllerHelp(void)
 		"\n";
 }
 
-void InstallExecutableDirectory::Respond(Script &State, HelpItemCollector *HelpItems)
+void InstallExecutableDirectory::Respond(QueryState &State, HelpItemCollector *HelpItems)
 {
 	String ProjectName = GetArgument(State, "Project");
 	ClearArguments(State);
@@ -90,7 +90,7 @@ void InstallLibraryDirectory::DisplayControllerHelp(void)
 		"\n";
 }
 
-void InstallLibraryDirectory::Respond(Script &State, HelpItemCollector *HelpItems)
+void InstallLibraryDirectory::Respond(QueryState &State, HelpItemCollector *HelpItems)
 {
 	String ProjectName = GetArgument(State, "Project");
 	ClearArguments(State);
@@ -148,7 +148,7 @@ void InstallDataDirectory::DisplayControllerHelp(void)
 		"\n";
 }
 
-void InstallDataDirectory::Respond(Script &State, HelpItemCollector *HelpItems)
+void InstallDataDirectory::Respond(QueryState &State, HelpItemCollector *HelpItems)
 {
 	String ProjectName = GetArgument(State, "Project");
 	ClearArguments(State);
@@ -193,7 +193,7 @@ void InstallGlobalConfigDirectory::DisplayControllerHelp(void)
 		"\n";
 }
 
-void InstallGlobalConfigDirectory::Respond(Script &State, HelpItemCollector *HelpItems)
+void InstallGlobalConfigDirectory::Respond(QueryState &State, HelpItemCollector *HelpItems)
 {
 	String ProjectName = GetArgument(State, "Project");
 	ClearArguments(State);
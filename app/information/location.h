@@ -8,7 +8,7 @@ class InstallExecutableDirectory
 	public:
 		static String GetIdentifier(void);
 		static void DisplayControllerHelp(void);
-		void Respond(Script &State, HelpItemCollector *HelpItems);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
 };
 
 class InstallLibraryDirectory
@@ -16,7 +16,7 @@ class InstallLibraryDirectory
 	public:
 		static String GetIdentifier(void);
 		static void DisplayControllerHelp(void);
-		void Respond(Script &State, HelpItemCollector *HelpItems);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
 };
 
 class InstallDataDirectory
@@ -24,7 +24,7 @@ class InstallDataDirectory
 	public:
 		static String GetIdentifier(void);
 		static void DisplayControllerHelp(void);
-		void Respond(Script &State, HelpItemCollector *HelpItems);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
 };
 
 class InstallGlobalConfigDirectory
@@ -32,7 +32,7 @@ class InstallGlobalConfigDirectory
 	public:
 		static String GetIdentifier(void);
 		static void DisplayControllerHelp(void);
-		void Respond(Script &State, HelpItemCollector *HelpItems);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
 };
 
 #endif // LOCATION_H
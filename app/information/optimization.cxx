@@ -0,0 +1,192 @@
+#include "optimization.h"
+
+#include <functional>
+
+#include "../shared.h"
+#include "../configuration.h"
+#include "../subprocess.h"
+#include "../probecache.h"
+#include "cxxcompiler.h"
+
+extern Information::AnchorImplementation<CXXCompiler> CXXCompilerInformation;
+extern ProbeCache ProbeResults;
+extern bool Verbose;
+
+struct Capability
+{
+	String const Name;
+	std::vector<String> const TestFlags;
+	std::vector<String> const ReportedFlags; // Flags the result vouches for, which may include some that can't be tested alone
+	bool const Link; // Otherwise compiling is enough, and the capability is tested along with the other compile-only ones
+};
+
+static std::vector<Capability> const Capabilities
+{
+	{"LTO", {"-flto"}, {"-flto"}, true},
+	{"ThinLTO", {"-flto=thin"}, {"-flto=thin"}, true},
+	// -fprofile-use needs profile data, which only exists once a -fprofile-generate build has run
+	{"PGO", {"-fprofile-generate"}, {"-fprofile-generate", "-fprofile-use"}, true},
+	{"GCSections", {"-ffunction-sections", "-fdata-sections", "-Wl,--gc-sections"}, {"-ffunction-sections", "-fdata-sections", "-Wl,--gc-sections"}, true},
+	{"MarchNative", {"-march=native"}, {"-march=native"}, false},
+	{"NoPLT", {"-fno-plt"}, {"-fno-plt"}, false},
+	{"HiddenVisibility", {"-fvisibility=hidden"}, {"-fvisibility=hidden"}, false}
+};
+
+String const OptimizationExample = "int Twice(int Value) { return Value * 2; }\nint main(int argc, char **argv) { return Twice(argc) == 0; }";
+
+String Optimization::GetIdentifier(void) { return "Optimization"; }
+
+void Optimization::DisplayControllerHelp(void)
+{
+	MemoryStream Names;
+	for (auto &Current : Capabilities) Names << (&Current == &Capabilities.front() ? "" : ", ") << Current.Name;
+	StandardStream << "\tDiscover." << GetIdentifier() << "{Compiler = PATH, LinkFlags = FLAGS}\n"
+		"\tResult: {CAPABILITY = SUPPORTED..., Flags = {FLAG = SUPPORTED...}}\n"
+		"\tTests which optimization features the compiler at PATH supports, or the compiler found by the most recent Discover.CXXCompiler if PATH is omitted.  CAPABILITY is one of: " << (String)Names << ".  Flags has every compiler flag those capabilities stand for, like -flto and -march=native, with whether it's supported.  FLAGS is an optional space-separated list of flags added when linking, like the flags from Discover.Linker; some linkers are needed for some kinds of LTO.\n"
+		"\tThe compile-only flags are tested together in one compilation, and each capability that needs linking is tested with one link, all at once.  Results are remembered until the compiler changes.\n"
+		"\n";
+}
+
+void Optimization::Respond(QueryState &State, HelpItemCollector *HelpItems)
+{
+	String const CompilerArgument = GetOptionalArgument(State, "Compiler");
+	String const LinkFlagsArgument = GetOptionalArgument(State, "LinkFlags");
+	ClearArguments(State);
+
+	if (HelpItems != nullptr)
+		for (auto &Current : Capabilities)
+			HelpItems->Add(GetIdentifier() + Current.Name + "=SUPPORTED", "Overrides whether the compiler supports " + Current.Name + ".  SUPPORTED is true or false.");
+
+	if (CompilerArgument.empty() && (CXXCompilerInformation->GetCompiler() == nullptr))
+		throw Error::Input("Discover." + GetIdentifier() + " needs a compiler.  Call Discover.CXXCompiler first or pass Compiler.");
+	FilePath const Compiler = !CompilerArgument.empty() ? FilePath::Qualify(CompilerArgument) : *CXXCompilerInformation->GetCompiler();
+
+	std::vector<String> LinkFlags;
+	for (std::queue<String> Parts = StringSplitter({' '}, true).Process(LinkFlagsArgument).Results(); !Parts.empty(); Parts.pop())
+		LinkFlags.push_back(Parts.front());
+
+	// Clang only warns about flags it doesn't support for the target, which mustn't pass as support
+	std::vector<String> StrictFlags;
+	if (Compiler.File().find("clang") != String::npos)
+		StrictFlags = {"-Werror=unused-command-line-argument", "-Werror=ignored-optimization-argument"};
+
+	std::map<String, bool> Supported; // By capability name
+	struct Probe
+	{
+		std::vector<Capability const *> Covers;
+		String Query;
+		Subprocess *Process;
+		FilePath Output;
+	};
+	std::vector<Probe> Probes;
+	SubprocessGroup Running;
+
+	std::function<void(std::vector<Capability const *> const &Covers, bool Passed)> Decide;
+	auto Start = [&](std::vector<Capability const *> const &Covers)
+	{
+		bool const Link = Covers.front()->Link;
+		// The example comes last, so clang doesn't see the flags as unused by a later -x none
+		std::vector<String> Arguments({"-x", "c++"});
+		for (auto &Flag : StrictFlags) Arguments.push_back(Flag);
+		for (auto Current : Covers) for (auto &Flag : Current->TestFlags) Arguments.push_back(Flag);
+		if (Link) for (auto &Flag : LinkFlags) Arguments.push_back(Flag);
+		else Arguments.push_back("-c");
+
+		MemoryStream Query;
+		Query << "optimization";
+		for (size_t Index = 2; Index < Arguments.size(); ++Index) Query << " " << Arguments[Index];
+		Query << " " << HashString(OptimizationExample);
+
+		auto Known = Results.find(Compiler.AsAbsoluteString() + "\t" + (String)Query);
+		if (Known != Results.end())
+		{
+			Decide(Covers, Known->second);
+			return;
+		}
+		std::pair<bool, String> Cached = ProbeResults.Find(Compiler, Query);
+		if (Cached.first)
+		{
+			Results[Compiler.AsAbsoluteString() + "\t" + (String)Query] = Cached.second == "1";
+			Decide(Covers, Cached.second == "1");
+			return;
+		}
+
+		FilePath Output = std::get<0>(CreateTemporaryFile(LocateTemporaryDirectory()));
+		Arguments.push_back("-o");
+		Arguments.push_back(Output.AsAbsoluteString());
+		Arguments.push_back("-");
+		if (Verbose)
+		{
+			StandardStream << "Testing";
+			for (auto Current : Covers) StandardStream << " " << Current->Name;
+			StandardStream << " with compiler \"" << Compiler << "\".\n" << OutputStream::Flush();
+		}
+		Subprocess &Process = Running.Start(Compiler, Arguments);
+		try { Process.In.Write(OptimizationExample + "\n"); }
+		catch (InteractionError &Failure)
+		{
+			// The compiler quit without reading the example, so it will report failure
+			if (Verbose) StandardStream << Failure.Explanation << "\n" << OutputStream::Flush();
+		}
+		Process.In.Close();
+		Probes.push_back(Probe{Covers, Query, &Process, Output});
+	};
+	Decide = [&](std::vector<Capability const *> const &Covers, bool Passed)
+	{
+		// When the compile-only batch fails, each of its capabilities gets a compilation of its own to find the culprits
+		if (!Passed && (Covers.size() > 1))
+		{
+			for (auto Current : Covers) Start({Current});
+			return;
+		}
+		for (auto Current : Covers) Supported[Current->Name] = Passed;
+	};
+
+	std::vector<Capability const *> CompileOnly;
+	for (auto &Current : Capabilities)
+	{
+		std::pair<bool, String> Override = FindConfiguration(GetIdentifier() + Current.Name);
+		if (Override.first)
+		{
+			if (Verbose) StandardStream << "Found " << Current.Name << " support by configuration.\n" << OutputStream::Flush();
+			Supported[Current.Name] = Override.second == "true";
+		}
+		else if (Current.Link) Start({&Current});
+		else CompileOnly.push_back(&Current);
+	}
+	if (!CompileOnly.empty()) Start(CompileOnly);
+
+	for (Subprocess *Done = Running.WaitAny(); Done != nullptr; Done = Running.WaitAny())
+	{
+		for (size_t Index = 0; Index < Probes.size(); ++Index)
+		{
+			if (Probes[Index].Process != Done) continue;
+			Probe Finished = Probes[Index]; // Decide may add probes, which would invalidate a reference
+			bool const Passed = Done->GetResult() == 0;
+			String const Errors = Done->Error.ReadAll();
+			if (Verbose && !Passed) StandardStream << "Compiler output:\n" << Errors << OutputStream::Flush();
+			Finished.Output.Delete();
+			Results[Compiler.AsAbsoluteString() + "\t" + Finished.Query] = Passed;
+			ProbeResults.Store(Compiler, Finished.Query, Passed ? "1" : "0");
+			Decide(Finished.Covers, Passed);
+			break;
+		}
+	}
+
+	State.PushTable();
+	for (auto &Current : Capabilities)
+	{
+		if (Verbose) StandardStream << Current.Name << " is " << (Supported[Current.Name] ? "" : "not ") << "supported.\n" << OutputStream::Flush();
+		State.PushBoolean(Supported[Current.Name]);
+		State.PutElement(Current.Name);
+	}
+	State.PushTable();
+	for (auto &Current : Capabilities)
+		for (auto &Flag : Current.ReportedFlags)
+		{
+			State.PushBoolean(Supported[Current.Name]);
+			State.PutElement(Flag);
+		}
+	State.PutElement("Flags");
+}
+
@@ -0,0 +1,19 @@
+#ifndef OPTIMIZATION_H
+#define OPTIMIZATION_H
+
+#include <map>
+
+#include "../information.h"
+
+class Optimization
+{
+	public:
+		static String GetIdentifier(void);
+		static void DisplayControllerHelp(void);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+
+	private:
+		std::map<String, bool> Results; // By compiler and probe, for this run
+};
+
+#endif // OPTIMIZATION_H
@@ -0,0 +1,194 @@
+#include "parallelism.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "../shared.h"
+#include "../configuration.h"
+#include "../runcache.h"
+
+extern bool Verbose;
+
+#ifdef __linux__
+// Returns the value on the line starting with Key in files like /proc/meminfo and memory.stat, or 0
+static unsigned long long ReadKeyedValue(String const &Path, String const &Key)
+{
+	std::ifstream Input(Path.c_str());
+	String Line;
+	while (std::getline(Input, Line))
+	{
+		if ((Line.compare(0, Key.length(), Key) != 0) || (Line.length() == Key.length()) || !isspace(Line[Key.length()])) continue;
+		return strtoull(Line.c_str() + Key.length(), nullptr, 10);
+	}
+	return 0;
+}
+
+// Limits may be set on any ancestor of this process's group, so every level up to the hierarchy root is checked
+static void ReadCGroupLimits(unsigned int &CPUs, unsigned long long &Memory)
+{
+	std::ifstream Groups("/proc/self/cgroup");
+	String Line;
+	while (std::getline(Groups, Line))
+	{
+		// Lines look like ID:CONTROLLERS:PATH, where the unified (v2) hierarchy has ID 0 and no controllers
+		size_t const FirstColon = Line.find(':'), SecondColon = Line.find(':', FirstColon + 1);
+		if ((FirstColon == String::npos) || (SecondColon == String::npos)) continue;
+		String const Controllers = Line.substr(FirstColon + 1, SecondColon - FirstColon - 1);
+		String Path = Line.substr(SecondColon + 1);
+		bool const Unified = Controllers.empty();
+		Set<String> ControllerSet;
+		for (std::queue<String> Parts = StringSplitter({','}, true).Process(Controllers).Results(); !Parts.empty(); Parts.pop())
+			ControllerSet.insert(Parts.front());
+		bool const HasCPU = Unified || ControllerSet.Contains("cpu"), HasMemory = Unified || ControllerSet.Contains("memory");
+		if (!HasCPU && !HasMemory) continue;
+
+		String const Root = Unified ? String("/sys/fs/cgroup") : "/sys/fs/cgroup/" + Controllers;
+		while (true)
+		{
+			String const Directory = Root + ((Path == "/") ? String() : Path) + "/";
+			if (HasCPU)
+			{
+				long long Quota = -1, Period = 0;
+				if (Unified)
+				{
+					// cpu.max holds "QUOTA PERIOD", where QUOTA may be max
+					RecordDependency(Directory + "cpu.max");
+					String const Limit = ReadFirstLine(Directory + "cpu.max");
+					if (!Limit.empty() && (Limit.compare(0, 3, "max") != 0))
+					{
+						char *End = nullptr;
+						Quota = strtoll(Limit.c_str(), &End, 10);
+						Period = strtoll(End, nullptr, 10);
+					}
+				}
+				else
+				{
+					RecordDependency(Directory + "cpu.cfs_quota_us");
+					RecordDependency(Directory + "cpu.cfs_period_us");
+					String const QuotaText = ReadFirstLine(Directory + "cpu.cfs_quota_us");
+					if (!QuotaText.empty()) Quota = strtoll(QuotaText.c_str(), nullptr, 10);
+					Period = strtoll(ReadFirstLine(Directory + "cpu.cfs_period_us").c_str(), nullptr, 10);
+				}
+				if ((Quota > 0) && (Period > 0))
+					CPUs = std::min<unsigned int>(CPUs, std::max<long long>(1, (Quota + Period - 1) / Period));
+			}
+			if (HasMemory)
+			{
+				RecordDependency(Directory + (Unified ? "memory.max" : "memory.limit_in_bytes"));
+				String const Limit = ReadFirstLine(Directory + (Unified ? "memory.max" : "memory.limit_in_bytes"));
+				if (!Limit.empty() && (Limit != "max"))
+				{
+					// Reclaimable page cache counts as used, so don't count it against the limit
+					unsigned long long const Maximum = strtoull(Limit.c_str(), nullptr, 10);
+					unsigned long long Used = strtoull(ReadFirstLine(Directory + (Unified ? "memory.current" : "memory.usage_in_bytes")).c_str(), nullptr, 10);
+					unsigned long long const Inactive = ReadKeyedValue(Directory + "memory.stat", Unified ? "inactive_file" : "total_inactive_file");
+					Used = (Inactive < Used) ? Used - Inactive : 0;
+					unsigned long long const Free = (Used < Maximum) ? Maximum - Used : 0;
+					if ((Memory == 0) || (Free < Memory)) Memory = Free;
+				}
+			}
+			if (Path.empty() || (Path == "/")) break;
+			size_t const Slash = Path.rfind('/');
+			Path = (Slash == 0) || (Slash == String::npos) ? String("/") : Path.substr(0, Slash);
+		}
+	}
+}
+#endif
+
+Parallelism::Parallelism(void) : CPUs(0), Memory(0)
+{
+#ifdef __linux__
+	cpu_set_t Affinity;
+	if (sched_getaffinity(0, sizeof(Affinity), &Affinity) == 0) CPUs = CPU_COUNT(&Affinity);
+	Memory = ReadKeyedValue("/proc/meminfo", "MemAvailable:") * 1024;
+	if (CPUs == 0) CPUs = std::thread::hardware_concurrency();
+	if (CPUs > 0) ReadCGroupLimits(CPUs, Memory);
+#else
+	CPUs = std::thread::hardware_concurrency();
+#if defined(_SC_AVPHYS_PAGES) && defined(_SC_PAGESIZE)
+	long const Pages = sysconf(_SC_AVPHYS_PAGES), PageSize = sysconf(_SC_PAGESIZE);
+	if ((Pages > 0) && (PageSize > 0)) Memory = static_cast<unsigned long long>(Pages) * PageSize;
+#endif
+#endif
+	if (CPUs == 0) CPUs = 1;
+
+	std::pair<bool, String> OverrideCPUs = FindConfiguration(GetIdentifier() + "CPUs"),
+		OverrideMemory = FindConfiguration(GetIdentifier() + "Memory");
+	if (OverrideCPUs.first)
+	{
+		if (Verbose) StandardStream << "Found CPU count by configuration.\n" << OutputStream::Flush();
+		CPUs = std::max(1ul, strtoul(OverrideCPUs.second.c_str(), nullptr, 10));
+	}
+	if (OverrideMemory.first)
+	{
+		if (Verbose) StandardStream << "Found available memory by configuration.\n" << OutputStream::Flush();
+		Memory = ParseSize(OverrideMemory.second);
+	}
+
+	if (Verbose) StandardStream << "Determined parallelism: " << CPUs << " CPUs, " << (Memory / (1024 * 1024)) << " MiB available memory\n" << OutputStream::Flush();
+}
+
+String Parallelism::GetIdentifier(void) { return "Parallelism"; }
+
+void Parallelism::DisplayControllerHelp(void)
+{
+	StandardStream << "\tDiscover." << GetIdentifier() << "{JobMemory = SIZE, LinkMemory = SIZE}\n"
+		"\tResult: {CPUs = COUNT, Memory = BYTES, CompileJobs = COUNT, LinkJobs = COUNT}\n"
+		"\tRecommends how many compile and link jobs to run at once.  CPUs is the number of CPUs this process may use, after affinity and cgroup CPU quotas.  Memory is the available memory in bytes, after cgroup memory limits, or 0 if unknown.  JobMemory and LinkMemory are optional estimates of the memory a single compile or link job uses, like 512M or 2G, and default to 1G and 4G.  Both job counts are at least 1.\n"
+		"\n";
+}
+
+void Parallelism::Respond(QueryState &State, HelpItemCollector *HelpItems)
+{
+	String const JobMemoryText = GetOptionalArgument(State, "JobMemory"),
+		LinkMemoryText = GetOptionalArgument(State, "LinkMemory");
+	ClearArguments(State);
+
+	unsigned long long const JobMemory = JobMemoryText.empty() ? 1024ull * 1024 * 1024 : ParseSize(JobMemoryText),
+		LinkMemory = LinkMemoryText.empty() ? 4ull * 1024 * 1024 * 1024 : ParseSize(LinkMemoryText);
+	if (JobMemory == 0) throw Error::Input("JobMemory \"" + JobMemoryText + "\" isn't a size, like 512M or 2G.");
+	if (LinkMemory == 0) throw Error::Input("LinkMemory \"" + LinkMemoryText + "\" isn't a size, like 512M or 2G.");
+
+	if (HelpItems != nullptr)
+	{
+		HelpItems->Add(GetIdentifier() + "CPUs=COUNT", "Overrides the number of CPUs available to the build.");
+		HelpItems->Add(GetIdentifier() + "Memory=SIZE", "Overrides the memory available to the build, like 16G.");
+		HelpItems->Add(GetIdentifier() + "CompileJobs=COUNT", "Overrides the recommended number of simultaneous compile jobs.");
+		HelpItems->Add(GetIdentifier() + "LinkJobs=COUNT", "Overrides the recommended number of simultaneous link jobs.");
+	}
+
+	auto CountJobs = [&](unsigned long long PerJob) -> unsigned int
+	{
+		if (Memory == 0) return CPUs;
+		return std::max<unsigned long long>(1, std::min<unsigned long long>(CPUs, Memory / PerJob));
+	};
+	unsigned int CompileJobs = CountJobs(JobMemory), LinkJobs = CountJobs(LinkMemory);
+
+	std::pair<bool, String> OverrideCompileJobs = FindConfiguration(GetIdentifier() + "CompileJobs"),
+		OverrideLinkJobs = FindConfiguration(GetIdentifier() + "LinkJobs");
+	if (OverrideCompileJobs.first) CompileJobs = std::max(1ul, strtoul(OverrideCompileJobs.second.c_str(), nullptr, 10));
+	if (OverrideLinkJobs.first) LinkJobs = std::max(1ul, strtoul(OverrideLinkJobs.second.c_str(), nullptr, 10));
+
+	if (Verbose) StandardStream << "Recommending " << CompileJobs << " compile jobs and " << LinkJobs << " link jobs.\n" << OutputStream::Flush();
+
+	State.PushTable();
+	State.PushInteger(CPUs);
+	State.PutElement("CPUs");
+	State.PushInteger(Memory);
+	State.PutElement("Memory");
+	State.PushInteger(CompileJobs);
+	State.PutElement("CompileJobs");
+	State.PushInteger(LinkJobs);
+	State.PutElement("LinkJobs");
+}
+
+unsigned int Parallelism::GetCPUs(void) const { return CPUs; }
+
+unsigned long long Parallelism::GetMemory(void) const { return Memory; }
+
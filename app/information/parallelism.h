@@ -0,0 +1,22 @@
+#ifndef PARALLELISM_H
+#define PARALLELISM_H
+
+#include "../information.h"
+
+class Parallelism
+{
+	public:
+		Parallelism(void);
+		static String GetIdentifier(void);
+		static void DisplayControllerHelp(void);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+		static bool const AnswersVaryBetweenRuns = true; // Because of available memory, affinity, and cgroup limits
+		unsigned int GetCPUs(void) const; // Usable by this process, after affinity and cgroup quotas
+		unsigned long long GetMemory(void) const; // Available bytes, after cgroup limits, 0 if unknown
+
+	private:
+		unsigned int CPUs;
+		unsigned long long Memory;
+};
+
+#endif // PARALLELISM_H
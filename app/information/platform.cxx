@@ -152,7 +152,7 @@ void Platform::DisplayControllerHelp(void)
 		"\n";
 }
 
-void Platform::Respond(Script &State, HelpItemCollector *HelpItems)
+void Platform::Respond(QueryState &State, HelpItemCollector *HelpItems)
 {
 	if (HelpItems != nullptr)
 	{
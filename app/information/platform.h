@@ -50,7 +50,7 @@ class Platform
 		Platform(void);
 		static String GetIdentifier(void);
 		static void DisplayControllerHelp(void);
-		void Respond(Script &State, HelpItemCollector *HelpItems);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
 		String const &GetFamily(void) const;
 		String const &GetMember(void) const;
 		unsigned int GetArchitectureBits(void) const;
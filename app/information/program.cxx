@@ -1,9 +1,15 @@
 #include "program.h"
 
 #include <cstdlib>
+#include <algorithm>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 #include "../shared.h"
 #include "../configuration.h"
+#include "../directoryindex.h"
+#include "../filesystemprobe.h"
 
 extern bool Verbose;
 
@@ -34,7 +40,29 @@ static std::vector<DirectoryPath> GetPathParts(void)
 	return std::move(Out);
 }
 
-Program::Program(void) : Paths(GetPathParts()) 
+static String MakeKey(String const &Filename)
+{
+#ifdef _WIN32
+	String Out = Filename;
+	for (auto &Character : Out) Character = tolower(Character);
+	return Out;
+#else
+	return Filename;
+#endif
+}
+
+// The mode bits say whether anyone may run a file; this says whether we may
+static bool MayExecute(String const &Path)
+{
+#ifdef _WIN32
+	(void)Path;
+	return true;
+#else
+	return access(Path.c_str(), X_OK) == 0;
+#endif
+}
+
+Program::Program(void) : Paths(GetPathParts()), Indexed(false)
 {
 	if (Verbose)
 	{
@@ -44,7 +72,7 @@ Program::Program(void) : Paths(GetPathParts())
 	}
 }
 
-void Program::Respond(Script &State, HelpItemCollector *HelpItems)
+void Program::Respond(QueryState &State, HelpItemCollector *HelpItems)
 {
 	auto ProgramNames = GetVariableArgument(State, "Name");
 	String ProgramName = ProgramNames[0];
@@ -82,50 +110,82 @@ void Program::Respond(Script &State, HelpItemCollector *HelpItems)
 	}
 }
 
+void Program::IndexPaths(void)
+{
+	if (Indexed) return;
+	Indexed = true;
+	for (unsigned int Index = 0; Index < Paths.size(); ++Index)
+	{
+		DirectoryIndex Listing(Paths[Index]);
+		if (!Listing.IsComplete())
+		{
+			UnlistedPaths.push_back(Index);
+			continue;
+		}
+		for (auto &Name : Listing.GetNames())
+		{
+			std::vector<unsigned int> &Locations = PathIndex[MakeKey(Name)];
+			if (Locations.empty() || (Locations.back() != Index)) Locations.push_back(Index);
+		}
+	}
+	if (Verbose) StandardStream << "Indexed " << PathIndex.size() << " filenames in PATH; " << UnlistedPaths.size() << " directories couldn't be listed.\n" << OutputStream::Flush();
+}
+
+std::vector<unsigned int> Program::GetCandidatePaths(std::vector<String> const &Filenames)
+{
+	IndexPaths();
+	std::vector<unsigned int> Out = UnlistedPaths;
+	for (auto &Filename : Filenames)
+	{
+		auto Found = PathIndex.find(MakeKey(Filename));
+		if (Found != PathIndex.end()) Out.insert(Out.end(), Found->second.begin(), Found->second.end());
+	}
+	std::sort(Out.begin(), Out.end());
+	Out.erase(std::unique(Out.begin(), Out.end()), Out.end());
+	return Out;
+}
+
 FilePath *Program::FindProgram(String const &ProgramName)
 {
-	// Check if we've already located a program
+	// Check if we've already looked for the program
 	auto FoundProgram = Programs.find(ProgramName);
-	if (FoundProgram == Programs.end()) 
+	if (FoundProgram != Programs.end()) return &FoundProgram->second;
+	if (MissingPrograms.Contains(ProgramName)) return nullptr;
+
+	// Check to see if the user's explicitly set the program's location
+	std::pair<bool, String> OverrideProgram = FindConfiguration(GetIdentifier() + "-" + ProgramName);
+	if (OverrideProgram.first)
 	{
-		// Check to see if the user's explicitly set the program's location
-		std::pair<bool, String> OverrideProgram = FindConfiguration(GetIdentifier() + "-" + ProgramName);
-		if (OverrideProgram.first)
+		FilePath OverridePath(FilePath::Qualify(OverrideProgram.second));
+		if (OverridePath.Exists())
 		{
-			FilePath OverridePath(FilePath::Qualify(OverrideProgram.second));
-			if (OverridePath.Exists())
-			{
-				if (Verbose) StandardStream << "Found program \"" << ProgramName << "\" at user-specified location " << OverridePath << "\n" << OutputStream::Flush();
-				Programs[ProgramName] = new FilePath(OverridePath);
-			}
+			if (Verbose) StandardStream << "Found program \"" << ProgramName << "\" at user-specified location " << OverridePath << "\n" << OutputStream::Flush();
+			return &Programs.insert(std::make_pair(ProgramName, OverridePath)).first->second;
 		}
-		else
-		{
-			// Do a search, directory-by-directory, through environment variable PATH
-			for (auto &NextPath : Paths)
-			{
-				FilePath NextFilePath = NextPath.Select(ProgramName);
-				if (NextFilePath.Exists())
-				{
-					if (Verbose) StandardStream << "Found program \"" << ProgramName << "\" at \"" << NextFilePath << "\".\n" << OutputStream::Flush();
-					Programs[ProgramName] = new FilePath(NextFilePath);
-					break;
-				}
+	}
+	else
+	{
+		// Search the directories in environment variable PATH that have a file by that name, in order
+		std::vector<String> Filenames{ProgramName};
 #ifdef _WIN32
-				NextFilePath = NextPath.Select(ProgramName + ".exe");
-				if (NextFilePath.Exists())
-				{
-					if (Verbose) StandardStream << "Found program \"" << ProgramName << "\" at \"" << NextFilePath << "\".\n" << OutputStream::Flush();
-					Programs[ProgramName] = new FilePath(NextFilePath);
-					break;
-				}
+		Filenames.push_back(ProgramName + ".exe");
 #endif
+		std::vector<FilePath> Candidates;
+		std::vector<String> CandidatePaths;
+		for (auto Index : GetCandidatePaths(Filenames))
+			for (auto &Filename : Filenames)
+			{
+				Candidates.push_back(Paths[Index].Select(Filename));
+				CandidatePaths.push_back(Candidates.back().AsAbsoluteString());
 			}
+		int const Index = FindFirstPath(CandidatePaths, [](String const &Path, PathStatus const &Status) { return Status.IsExecutable && MayExecute(Path); });
+		if (Index != -1)
+		{
+			if (Verbose) StandardStream << "Found program \"" << ProgramName << "\" at \"" << Candidates[Index] << "\".\n" << OutputStream::Flush();
+			return &Programs.insert(std::make_pair(ProgramName, Candidates[Index])).first->second;
 		}
-		FoundProgram = Programs.find(ProgramName);
 	}
-	if (FoundProgram == Programs.end())
-		return nullptr;
-	return FoundProgram->second;
+	if (Verbose) StandardStream << "Program \"" << ProgramName << "\" wasn't found.\n" << OutputStream::Flush();
+	MissingPrograms.insert(ProgramName);
+	return nullptr;
 }
-
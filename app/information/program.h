@@ -3,8 +3,10 @@
 #endif
 #define PROGRAM_H
 
+#include <map>
+#include <unordered_map>
+
 #include "../information.h"
-#include "../ren-general/lifetime.h"
 #include "../ren-general/filesystem.h"
 
 class Program
@@ -12,11 +14,18 @@ class Program
 	public:
 		static String GetIdentifier(void);
 		static void DisplayControllerHelp(void);
-		void Respond(Script &State, HelpItemCollector *HelpItems);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
 		Program(void);
 		FilePath *FindProgram(String const &ProgramName);
 	private:
+		void IndexPaths(void);
+		std::vector<unsigned int> GetCandidatePaths(std::vector<String> const &Filenames);
+
 		std::vector<DirectoryPath> const Paths;
-		DeleterMap<String, FilePath> Programs;
+		bool Indexed;
+		std::unordered_map<String, std::vector<unsigned int> > PathIndex; // Filename to the PATH entries containing it, in PATH order
+		std::vector<unsigned int> UnlistedPaths; // PATH entries that couldn't be read and must be checked file by file
+		std::map<String, FilePath> Programs;
+		Set<String> MissingPrograms;
 };
 
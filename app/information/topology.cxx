@@ -0,0 +1,242 @@
+#include "topology.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "../shared.h"
+#include "../configuration.h"
+#include "../directoryindex.h"
+
+extern bool Verbose;
+
+// Reads kernel CPU lists like 0-3,8-11
+static std::vector<unsigned int> ParseCPUList(String const &Text)
+{
+	std::vector<unsigned int> Out;
+	std::queue<String> Ranges = StringSplitter({','}, true).Process(Text).Results();
+	while (!Ranges.empty())
+	{
+		String const Range = Ranges.front();
+		Ranges.pop();
+		size_t const Dash = Range.find('-');
+		unsigned int const First = strtoul(Range.c_str(), nullptr, 10);
+		unsigned int const Last = (Dash == String::npos) ? First : strtoul(Range.c_str() + Dash + 1, nullptr, 10);
+		for (unsigned int CPU = First; CPU <= Last; ++CPU) Out.push_back(CPU);
+	}
+	return Out;
+}
+
+Topology::Topology(void) : CacheLineSize(0)
+{
+#ifdef __linux__
+	// GetNames refers into the index, so each index is kept for its loop
+	String const CacheBase = "/sys/devices/system/cpu/cpu0/cache/";
+	DirectoryIndex const CacheDirectory(DirectoryPath::Qualify(CacheBase));
+	for (auto &Name : CacheDirectory.GetNames())
+	{
+		if (Name.compare(0, 5, "index") != 0) continue;
+		String const Base = CacheBase + Name + "/";
+		Cache Next;
+		Next.Level = strtoul(ReadFirstLine(Base + "level").c_str(), nullptr, 10);
+		Next.Type = ReadFirstLine(Base + "type");
+		Next.Size = ParseSize(ReadFirstLine(Base + "size"));
+		Next.LineSize = strtoul(ReadFirstLine(Base + "coherency_line_size").c_str(), nullptr, 10);
+		Next.Associativity = strtoul(ReadFirstLine(Base + "ways_of_associativity").c_str(), nullptr, 10);
+		Next.Sets = strtoul(ReadFirstLine(Base + "number_of_sets").c_str(), nullptr, 10);
+		Next.SharedCPUs = ParseCPUList(ReadFirstLine(Base + "shared_cpu_list")).size();
+		if ((Next.Level == 0) || Next.Type.empty()) continue;
+		Caches.push_back(Next);
+	}
+
+	String const NodeBase = "/sys/devices/system/node/";
+	DirectoryIndex const NodeDirectory(DirectoryPath::Qualify(NodeBase));
+	for (auto &Name : NodeDirectory.GetNames())
+	{
+		if ((Name.compare(0, 4, "node") != 0) || (Name.length() == 4) || !isdigit(Name[4])) continue;
+		Node Next;
+		Next.Identifier = strtoul(Name.c_str() + 4, nullptr, 10);
+		Next.CPUs = ParseCPUList(ReadFirstLine(NodeBase + Name + "/cpulist"));
+		Nodes.push_back(Next);
+	}
+
+	// Directories like hugepages-2048kB
+	DirectoryIndex const HugePageDirectory(DirectoryPath::Qualify("/sys/kernel/mm/hugepages"));
+	for (auto &Name : HugePageDirectory.GetNames())
+		if (Name.compare(0, 10, "hugepages-") == 0) HugePageSizes.push_back(ParseSize(Name.substr(10)));
+
+	// The selected mode is bracketed, as in "always [madvise] never"
+	String const Modes = ReadFirstLine("/sys/kernel/mm/transparent_hugepage/enabled");
+	size_t const Open = Modes.find('['), Close = Modes.find(']');
+	if ((Open != String::npos) && (Close != String::npos) && (Open < Close)) TransparentHugePages = Modes.substr(Open + 1, Close - Open - 1);
+#endif
+	std::sort(Caches.begin(), Caches.end(), [](Cache const &First, Cache const &Second)
+		{ return (First.Level < Second.Level) || ((First.Level == Second.Level) && (First.Type < Second.Type)); });
+	std::sort(Nodes.begin(), Nodes.end(), [](Node const &First, Node const &Second) { return First.Identifier < Second.Identifier; });
+	std::sort(HugePageSizes.begin(), HugePageSizes.end());
+
+	for (auto &Current : Caches)
+		if ((Current.Level == 1) && (Current.Type != "Instruction")) CacheLineSize = Current.LineSize;
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+	if (CacheLineSize == 0)
+	{
+		long const Reported = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+		if (Reported > 0) CacheLineSize = Reported;
+	}
+#endif
+
+	for (unsigned int Level = 1; Level <= 4; ++Level)
+	{
+		std::pair<bool, String> OverrideSize = FindConfiguration(MemoryStream() << GetIdentifier() << "L" << Level << "Size");
+		if (!OverrideSize.first) continue;
+		if (Verbose) StandardStream << "Found level " << Level << " cache size by configuration.\n" << OutputStream::Flush();
+		bool Replaced = false;
+		for (auto &Current : Caches)
+			if ((Current.Level == Level) && (Current.Type != "Instruction"))
+			{
+				Current.Size = ParseSize(OverrideSize.second);
+				Replaced = true;
+			}
+		if (!Replaced)
+		{
+			Cache Added{Level, "Unified", ParseSize(OverrideSize.second), CacheLineSize, 0, 0, 0};
+			Caches.insert(std::upper_bound(Caches.begin(), Caches.end(), Added, [](Cache const &First, Cache const &Second) { return First.Level < Second.Level; }), Added);
+		}
+	}
+	std::pair<bool, String> OverrideLineSize = FindConfiguration(GetIdentifier() + "CacheLineSize"),
+		OverrideNodes = FindConfiguration(GetIdentifier() + "Nodes"),
+		OverrideHugePageSizes = FindConfiguration(GetIdentifier() + "HugePageSizes"),
+		OverrideTransparentHugePages = FindConfiguration(GetIdentifier() + "TransparentHugePages");
+	if (OverrideLineSize.first)
+	{
+		if (Verbose) StandardStream << "Found cache line size by configuration.\n" << OutputStream::Flush();
+		CacheLineSize = strtoul(OverrideLineSize.second.c_str(), nullptr, 10);
+	}
+	if (OverrideNodes.first)
+	{
+		if (Verbose) StandardStream << "Found NUMA nodes by configuration.\n" << OutputStream::Flush();
+		Nodes.clear();
+		std::queue<String> Lists = StringSplitter({';'}, false).Process(OverrideNodes.second).Results();
+		for (unsigned int Identifier = 0; !Lists.empty(); ++Identifier, Lists.pop())
+			Nodes.push_back(Node{Identifier, ParseCPUList(Lists.front())});
+	}
+	if (OverrideHugePageSizes.first)
+	{
+		if (Verbose) StandardStream << "Found huge page sizes by configuration.\n" << OutputStream::Flush();
+		HugePageSizes.clear();
+		std::queue<String> Sizes = StringSplitter({','}, true).Process(OverrideHugePageSizes.second).Results();
+		for (; !Sizes.empty(); Sizes.pop()) HugePageSizes.push_back(ParseSize(Sizes.front()));
+	}
+	if (OverrideTransparentHugePages.first)
+	{
+		if (Verbose) StandardStream << "Found transparent huge page mode by configuration.\n" << OutputStream::Flush();
+		TransparentHugePages = OverrideTransparentHugePages.second;
+	}
+
+	if (Verbose)
+	{
+		StandardStream << "Determined memory topology: cache line " << CacheLineSize << " bytes";
+		for (auto &Current : Caches) StandardStream << ", L" << Current.Level << " " << Current.Type << " " << Current.Size << " bytes";
+		StandardStream << ", " << Nodes.size() << " NUMA nodes, " << HugePageSizes.size() << " huge page sizes, transparent huge pages " << (TransparentHugePages.empty() ? String("unknown") : TransparentHugePages) << "\n" << OutputStream::Flush();
+	}
+}
+
+String Topology::GetIdentifier(void) { return "Topology"; }
+
+void Topology::DisplayControllerHelp(void)
+{
+	StandardStream << "\tDiscover." << GetIdentifier() << "{}\n"
+		"\tResult: {Caches = {{Level = LEVEL, Type = TYPE, Size = SIZE, LineSize = LINESIZE, Associativity = WAYS, Sets = SETS, SharedCPUs = COUNT}...}, L1Size = SIZE, L2Size = SIZE, L3Size = SIZE, CacheLineSize = LINESIZE, Nodes = {{Id = NODE, CPUs = {CPU...}}...}, HugePageSizes = {SIZE...}, TransparentHugePages = MODE}\n"
+		"\tDescribes the memory hierarchy of the machine discovery is running on.  TYPE is Data, Instruction, or Unified, and every SIZE is in bytes.  L1Size, L2Size, and L3Size are the sizes of the data or unified cache at that level, and are missing if the level doesn't exist.  Nodes lists the CPUs in each NUMA node.  MODE is the transparent huge page setting: always, madvise, or never.  Values that can't be determined are 0, empty, or missing.\n"
+		"\n";
+}
+
+void Topology::Respond(QueryState &State, HelpItemCollector *HelpItems)
+{
+	if (HelpItems != nullptr)
+	{
+		HelpItems->Add(GetIdentifier() + "L1Size=SIZE", "Overrides the size of the level 1 data cache.  SIZE is in bytes and may end in K, M, or G.  " + GetIdentifier() + "L2Size, " + GetIdentifier() + "L3Size, and " + GetIdentifier() + "L4Size override the other levels.");
+		HelpItems->Add(GetIdentifier() + "CacheLineSize=SIZE", "Overrides the cache line size in bytes.");
+		HelpItems->Add(GetIdentifier() + "Nodes=CPULIST;CPULIST...", "Overrides the NUMA nodes, listing the CPUs of each node (like 0-7,16-23) in order.");
+		HelpItems->Add(GetIdentifier() + "HugePageSizes=SIZE,SIZE...", "Overrides the available huge page sizes.");
+		HelpItems->Add(GetIdentifier() + "TransparentHugePages=MODE", "Overrides the transparent huge page mode.");
+	}
+	State.PushTable();
+
+	State.PushTable();
+	for (unsigned int Index = 1; Index <= Caches.size(); ++Index)
+	{
+		Cache const &Current = Caches[Index - 1];
+		State.PushTable();
+		State.PushInteger(Current.Level);
+		State.PutElement("Level");
+		State.PushString(Current.Type);
+		State.PutElement("Type");
+		State.PushInteger(Current.Size);
+		State.PutElement("Size");
+		State.PushInteger(Current.LineSize);
+		State.PutElement("LineSize");
+		State.PushInteger(Current.Associativity);
+		State.PutElement("Associativity");
+		State.PushInteger(Current.Sets);
+		State.PutElement("Sets");
+		State.PushInteger(Current.SharedCPUs);
+		State.PutElement("SharedCPUs");
+		State.PutElement(Index);
+	}
+	State.PutElement("Caches");
+	for (unsigned int Level = 1; Level <= 3; ++Level)
+	{
+		unsigned long long const Size = GetCacheSize(Level);
+		if (Size == 0) continue;
+		State.PushInteger(Size);
+		State.PutElement(MemoryStream() << "L" << Level << "Size");
+	}
+	State.PushInteger(CacheLineSize);
+	State.PutElement("CacheLineSize");
+
+	State.PushTable();
+	for (unsigned int Index = 1; Index <= Nodes.size(); ++Index)
+	{
+		Node const &Current = Nodes[Index - 1];
+		State.PushTable();
+		State.PushInteger(Current.Identifier);
+		State.PutElement("Id");
+		State.PushTable();
+		for (unsigned int CPUIndex = 1; CPUIndex <= Current.CPUs.size(); ++CPUIndex)
+		{
+			State.PushInteger(Current.CPUs[CPUIndex - 1]);
+			State.PutElement(CPUIndex);
+		}
+		State.PutElement("CPUs");
+		State.PutElement(Index);
+	}
+	State.PutElement("Nodes");
+
+	State.PushTable();
+	for (unsigned int Index = 1; Index <= HugePageSizes.size(); ++Index)
+	{
+		State.PushInteger(HugePageSizes[Index - 1]);
+		State.PutElement(Index);
+	}
+	State.PutElement("HugePageSizes");
+
+	if (!TransparentHugePages.empty())
+	{
+		State.PushString(TransparentHugePages);
+		State.PutElement("TransparentHugePages");
+	}
+}
+
+unsigned long long Topology::GetCacheSize(unsigned int Level) const
+{
+	for (auto &Current : Caches)
+		if ((Current.Level == Level) && (Current.Type != "Instruction")) return Current.Size;
+	return 0;
+}
+
+unsigned int Topology::GetCacheLineSize(void) const { return CacheLineSize; }
+
+std::vector<Topology::Node> const &Topology::GetNodes(void) const { return Nodes; }
+
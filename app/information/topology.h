@@ -0,0 +1,40 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include "../information.h"
+
+class Topology
+{
+	public:
+		struct Cache
+		{
+			unsigned int Level;
+			String Type; // Data, Instruction, or Unified
+			unsigned long long Size;
+			unsigned int LineSize, Associativity, Sets, SharedCPUs;
+		};
+		struct Node
+		{
+			unsigned int Identifier;
+			std::vector<unsigned int> CPUs;
+		};
+
+		Topology(void);
+		static String GetIdentifier(void);
+		static void DisplayControllerHelp(void);
+		void Respond(QueryState &State, HelpItemCollector *HelpItems);
+		static bool const AnswersVaryBetweenRuns = true; // Because sysfs can't be fingerprinted
+		unsigned long long GetCacheSize(unsigned int Level) const; // Of the data or unified cache at Level, 0 if unknown
+		unsigned int GetCacheLineSize(void) const;
+		std::vector<Node> const &GetNodes(void) const;
+
+	private:
+		std::vector<Cache> Caches;
+		unsigned int CacheLineSize;
+		std::vector<Node> Nodes;
+		std::vector<unsigned long long> HugePageSizes;
+		String TransparentHugePages;
+};
+
+#endif // TOPOLOGY_H
+
@@ -10,6 +10,6 @@ class Version
 	public:
 		static String GetIdentifier(void);
 		static void DisplayControllerHelp(void);
-		void Respond(Script &State, HelpItemCollector *);
+		void Respond(QueryState &State, HelpItemCollector *);
 };
 
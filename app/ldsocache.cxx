@@ -0,0 +1,189 @@
+#include "ldsocache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#ifndef WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "shared.h"
+#include "runcache.h"
+
+extern bool Verbose;
+
+// Layouts from glibc's sysdeps/generic/dl-cache.h
+char const OldMagic[] = "ld.so-1.7.0";
+char const NewMagic[] = "glibc-ld.so.cache";
+char const NewVersion[] = "1.1";
+size_t const OldHeaderSize = 16, OldEntrySize = 12;
+size_t const NewHeaderSize = 48, NewEntrySize = 24;
+int32_t const TypeMask = 0x00ff, ELFLibC6 = 0x0003;
+
+// The flags ldconfig gives libraries for this architecture, or -1 if only the library type can be checked
+static int32_t GetRequiredFlags(unsigned int ArchitectureBits)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return ArchitectureBits == 64 ? ELFLibC6 | 0x0300 : ELFLibC6;
+#elif defined(__aarch64__) || defined(__arm__)
+#if defined(__ARM_PCS_VFP) || defined(__aarch64__)
+	return ArchitectureBits == 64 ? ELFLibC6 | 0x0a00 : ELFLibC6 | 0x0900;
+#else
+	return ArchitectureBits == 64 ? ELFLibC6 | 0x0a00 : ELFLibC6 | 0x0b00;
+#endif
+#elif defined(__powerpc__) || defined(__powerpc64__)
+	return ArchitectureBits == 64 ? ELFLibC6 | 0x0500 : ELFLibC6;
+#elif defined(__s390__) || defined(__s390x__)
+	return ArchitectureBits == 64 ? ELFLibC6 | 0x0400 : ELFLibC6;
+#elif defined(__sparc__)
+	return ArchitectureBits == 64 ? ELFLibC6 | 0x0100 : ELFLibC6;
+#elif defined(__riscv) && defined(__riscv_float_abi_double)
+	return ELFLibC6 | 0x1000;
+#else
+	(void)ArchitectureBits;
+	return -1;
+#endif
+}
+
+template <typename Type> static Type ReadField(unsigned char const *Data, size_t Offset)
+{
+	Type Out;
+	memcpy(&Out, Data + Offset, sizeof(Type));
+	return Out;
+}
+
+LinkerCache::LinkerCache(FilePath const &Location, unsigned int ArchitectureBits) : Loaded(false)
+{
+#ifndef WINDOWS
+	String const Path = Location.AsAbsoluteString();
+	RecordDependency(Path);
+	int Descriptor = open(Path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (Descriptor == -1) return;
+	struct stat Status;
+	if ((fstat(Descriptor, &Status) == -1) || (Status.st_size < static_cast<off_t>(OldHeaderSize)))
+	{
+		close(Descriptor);
+		return;
+	}
+	size_t const Size = Status.st_size;
+	void *Mapping = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, Descriptor, 0);
+	close(Descriptor);
+	if (Mapping == MAP_FAILED) return;
+	unsigned char const *Data = static_cast<unsigned char const *>(Mapping);
+
+	int32_t const RequiredFlags = GetRequiredFlags(ArchitectureBits);
+	auto Accept = [&](int32_t Flags)
+	{
+		if (RequiredFlags == -1) return (Flags & TypeMask) == ELFLibC6;
+		return Flags == RequiredFlags;
+	};
+	// Offsets are relative to StringBase; names that don't end inside the file are dropped
+	auto ReadString = [&](size_t StringBase, uint32_t Offset, String &Out)
+	{
+		size_t const Start = StringBase + Offset;
+		if (Start >= Size) return false;
+		void const *End = memchr(Data + Start, 0, Size - Start);
+		if (End == nullptr) return false;
+		Out.assign(reinterpret_cast<char const *>(Data + Start), static_cast<unsigned char const *>(End) - (Data + Start));
+		return true;
+	};
+	auto Add = [&](size_t StringBase, uint32_t Key, uint32_t Value)
+	{
+		Entry New;
+		New.Order = Entries.size();
+		if (!ReadString(StringBase, Key, New.Name) || !ReadString(StringBase, Value, New.Path)) return;
+		Entries.push_back(std::move(New));
+	};
+
+	// Caches from glibc before 2.32 start with the old format and put the new one after its entries
+	size_t NewStart = 0;
+	bool HaveNew = false;
+	if (memcmp(Data, OldMagic, sizeof(OldMagic) - 1) == 0)
+	{
+		uint32_t const OldCount = ReadField<uint32_t>(Data, 12);
+		size_t const OldEnd = OldHeaderSize + static_cast<size_t>(OldCount) * OldEntrySize;
+		if (OldEnd <= Size)
+		{
+			NewStart = (OldEnd + 7) & ~static_cast<size_t>(7);
+			HaveNew = (NewStart + NewHeaderSize <= Size) && (memcmp(Data + NewStart, NewMagic, sizeof(NewMagic) - 1) == 0);
+			if (!HaveNew)
+			{
+				for (uint32_t Index = 0; Index < OldCount; ++Index)
+				{
+					size_t const Offset = OldHeaderSize + Index * OldEntrySize;
+					if (!Accept(ReadField<int32_t>(Data, Offset))) continue;
+					Add(OldEnd, ReadField<uint32_t>(Data, Offset + 4), ReadField<uint32_t>(Data, Offset + 8));
+				}
+				Loaded = true;
+			}
+		}
+	}
+	else HaveNew = (Size >= NewHeaderSize) && (memcmp(Data, NewMagic, sizeof(NewMagic) - 1) == 0);
+
+	if (HaveNew && (memcmp(Data + NewStart + sizeof(NewMagic) - 1, NewVersion, sizeof(NewVersion) - 1) == 0))
+	{
+		uint8_t const Endianness = Data[NewStart + 28] & 3;
+		uint16_t const Probe = 1;
+		bool const HostLittle = *reinterpret_cast<uint8_t const *>(&Probe) == 1;
+		if ((Endianness < 2) || ((Endianness == 2) == HostLittle))
+		{
+			uint32_t const Count = ReadField<uint32_t>(Data, NewStart + 20);
+			if (NewStart + NewHeaderSize + static_cast<size_t>(Count) * NewEntrySize <= Size)
+			{
+				for (uint32_t Index = 0; Index < Count; ++Index)
+				{
+					size_t const Offset = NewStart + NewHeaderSize + Index * NewEntrySize;
+					if (!Accept(ReadField<int32_t>(Data, Offset))) continue;
+					// Libraries in hwcaps subdirectories are only used when the processor supports them
+					if (ReadField<uint64_t>(Data, Offset + 16) != 0) continue;
+					Add(NewStart, ReadField<uint32_t>(Data, Offset + 4), ReadField<uint32_t>(Data, Offset + 8));
+				}
+				Loaded = true;
+			}
+		}
+	}
+	munmap(Mapping, Size);
+
+	std::stable_sort(Entries.begin(), Entries.end(), [](Entry const &First, Entry const &Second) { return First.Name < Second.Name; });
+	if (Verbose)
+	{
+		if (Loaded) StandardStream << "Read " << Entries.size() << " usable libraries from " << Path << ".\n" << OutputStream::Flush();
+		else StandardStream << "Couldn't read the loader cache " << Path << ".\n" << OutputStream::Flush();
+	}
+#else
+	(void)Location;
+	(void)ArchitectureBits;
+#endif
+}
+
+bool LinkerCache::IsLoaded(void) const { return Loaded; }
+
+std::vector<String> LinkerCache::Find(String const &Name) const
+{
+	std::vector<Entry const *> Matches;
+	auto Collect = [&](String const &Prefix, bool Exact)
+	{
+		auto Position = std::lower_bound(Entries.begin(), Entries.end(), Prefix, [](Entry const &Test, String const &Key) { return Test.Name < Key; });
+		for (; (Position != Entries.end()) && (Position->Name.compare(0, Prefix.length(), Prefix) == 0); ++Position)
+		{
+			// lib<Name>.so must be followed by nothing or a version so libfoo.so doesn't match libfoo.so-extra
+			if (Exact ? (Position->Name.length() != Prefix.length()) :
+				((Position->Name.length() > Prefix.length()) && (Position->Name[Prefix.length()] != '.')))
+				continue;
+			Matches.push_back(&*Position);
+		}
+	};
+	Collect("lib" + Name + ".so", false);
+	Collect(Name, true);
+
+	// ldconfig writes entries in the order the loader searches them
+	std::sort(Matches.begin(), Matches.end(), [](Entry const *First, Entry const *Second) { return First->Order < Second->Order; });
+	std::vector<String> Out;
+	for (auto Match : Matches)
+		if (std::find(Out.begin(), Out.end(), Match->Path) == Out.end()) Out.push_back(Match->Path);
+	return Out;
+}
+
@@ -0,0 +1,29 @@
+#ifndef LDSOCACHE_H
+#define LDSOCACHE_H
+
+#include <vector>
+
+#include "ren-general/string.h"
+#include "ren-general/filesystem.h"
+
+// The dynamic linker's index of installed shared libraries (/etc/ld.so.cache), in both the old and the glibc-ld.so.cache1.1 formats.  Only entries the loader would use for a process with the given architecture are kept: ones with matching architecture flags and no hardware capability requirements.
+class LinkerCache
+{
+	public:
+		LinkerCache(FilePath const &Location, unsigned int ArchitectureBits);
+		bool IsLoaded(void) const;
+		// Returns the paths of shared libraries named Name or lib<Name>.so[.VERSION], in the order the loader prefers them
+		std::vector<String> Find(String const &Name) const;
+
+	private:
+		struct Entry
+		{
+			String Name, Path;
+			unsigned int Order;
+		};
+		bool Loaded;
+		std::vector<Entry> Entries; // Sorted by name
+};
+
+#endif // LDSOCACHE_H
+
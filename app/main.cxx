@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <cstring>
+#include <csignal>
 #include <queue>
 
 #include "ren-general/string.h"
@@ -12,6 +13,8 @@
 #include "shared.h"
 #include "configuration.h"
 #include "shellutility.h"
+#include "probecache.h"
+#include "runcache.h"
 
 // Global information and information types - used in main loop and in individual info types and such
 enum RunModes { Normal, Help, ControllerHelp } RunMode = Normal;
@@ -20,21 +23,43 @@ bool Verbose = false;
 #include "information/version.h"
 #include "information/flag.h"
 #include "information/platform.h"
+#include "information/cpu.h"
+#include "information/topology.h"
+#include "information/filesystemcapabilities.h"
+#include "information/kernel.h"
+#include "information/parallelism.h"
 #include "information/location.h"
 #include "information/program.h"
 #include "information/cxxcompiler.h"
+#include "information/linker.h"
+#include "information/compilercache.h"
+#include "information/optimization.h"
 #include "information/clibrary.h"
+#include "information/allocator.h"
 		
 Information::AnchorImplementation<Version> VersionInformation;
 Information::AnchorImplementation<Flag> FlagInformation;
 Information::AnchorImplementation<Platform> PlatformInformation;
+Information::AnchorImplementation<CPU> CPUInformation;
+Information::AnchorImplementation<Topology> TopologyInformation;
+Information::AnchorImplementation<FilesystemCapabilities> FilesystemInformation;
+Information::AnchorImplementation<Kernel> KernelInformation;
+Information::AnchorImplementation<Parallelism> ParallelismInformation;
 Information::AnchorImplementation<InstallExecutableDirectory> ExecutableInstallInformation;
 Information::AnchorImplementation<InstallLibraryDirectory> LibraryInstallInformation;
 Information::AnchorImplementation<InstallDataDirectory> DataInstallInformation;
 Information::AnchorImplementation<InstallGlobalConfigDirectory> ConfigInstallInformation;
 Information::AnchorImplementation<Program> ProgramInformation;
 Information::AnchorImplementation<CXXCompiler> CXXCompilerInformation;
+Information::AnchorImplementation<Linker> LinkerInformation;
+Information::AnchorImplementation<CompilerCache> CompilerCacheInformation;
+Information::AnchorImplementation<Optimization> OptimizationInformation;
 Information::AnchorImplementation<CLibrary> CLibraryInformation;
+Information::AnchorImplementation<Allocator> AllocatorInformation;
+
+ProbeCache ProbeResults(LocateUserConfigFile("selfdiscovery.cache"));
+RunCache RunResults(LocateUserConfigFile("selfdiscovery.runcache"));
+LockFile LockResults(LocateWorkingDirectory().Select("selfdiscovery.lock"));
 
 std::vector<const char *> HelpNames = {"Help", "--help", "-h", "ControllerHelp"};
 
@@ -45,6 +70,11 @@ std::vector<FilePath> ConfigurationFilePaths = {
 
 int main(int argc, char **argv)
 {
+#ifndef WINDOWS
+	// Subprocesses may exit without reading everything we write to them, which should be a write error rather than fatal
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
 	try 
 	{
 		// Determine the controller
@@ -84,13 +114,22 @@ int main(int argc, char **argv)
 			&VersionInformation,
 			&FlagInformation,
 			&PlatformInformation,
+			&CPUInformation,
+			&TopologyInformation,
+			&FilesystemInformation,
+			&KernelInformation,
+			&ParallelismInformation,
 			&ExecutableInstallInformation,
 			&LibraryInstallInformation,
 			&DataInstallInformation,
 			&ConfigInstallInformation,
 			&ProgramInformation,
 			&CXXCompilerInformation,
-			&CLibraryInformation});
+			&LinkerInformation,
+			&CompilerCacheInformation,
+			&OptimizationInformation,
+			&CLibraryInformation,
+			&AllocatorInformation});
 
 		// Display controller help and exit early if that flag was set
 		if (RunMode == RunModes::ControllerHelp)
@@ -113,7 +152,7 @@ int main(int argc, char **argv)
 				"\tselfdiscovery CONTROLLER CONFIGURATION...\n"
 				"\n"
 				"\tThis program gathers information about your system for a controller script.  Generally, this is used by software build scripts to configure themselves for your system.  The controller script filename is specified by CONTROLLER.  The controller tells this program which information it should gather.\n"
-				"\tCONFIGURATION... can be any number of the following values in addition to the items in the next section: Help, ControllerHelp, Verbose.  Help displays this message.  ControllerHelp displays documentation for writing controller scripts.  Verbose displays messages while discovery is in progress that are intended to clarify how and what information is being found.  If you specify CONTROLLER as well as Help, additional flags that can be used to override or guide information discovery will be listed below.\n"
+				"\tCONFIGURATION... can be any number of the following values in addition to the items in the next section: Help, ControllerHelp, Verbose, NoProbeCache, NoRunCache, Lock, UseLock.  Help displays this message.  ControllerHelp displays documentation for writing controller scripts.  Verbose displays messages while discovery is in progress that are intended to clarify how and what information is being found.  NoProbeCache makes discovery ignore and not update the results of earlier compiler probes, which are otherwise remembered in " << ProbeResults.GetLocation() << ".  NoRunCache makes discovery ignore and not update the record of the controller's last run, which is kept for each controller in " << RunResults.GetLocation() << ", which otherwise answers every query when the controller, configuration, PATH, LD_LIBRARY_PATH and PKG_CONFIG_ variables, and the files the answers came from are unchanged since that run and the system hasn't been restarted or the CPU affinity changed.  Parallelism, Topology, Kernel, Filesystem, and CompilerCache queries are always discovered.  Lock writes every query, its answer, and the files and directories the answer depended on to " << LockResults.GetLocation() << ".  UseLock checks those files and directories and replays the answers that still hold instead of discovering them, only discovering the queries whose files changed; specify both to also update the lock.  The run cache isn't used with either.  If you specify CONTROLLER as well as Help, additional flags that can be used to override or guide information discovery will be listed below.\n"
 				"\tAny values you can specify in CONFIGURATION... can also be placed in configuration files that will be automatically loaded.  Only one value may be specified per line.  The values loaded from the configuration files will supplement the CONFIGURATION... specified in the command line, but have lower precedence than the command line values.  The configuration files automatically loaded are, by increasing precedence: \n";
 			for (auto &ConfigurationFilePath : ConfigurationFilePaths)
 				StandardStream << "\t" << ConfigurationFilePath << "\n";
@@ -165,7 +204,14 @@ int main(int argc, char **argv)
 		ControlScript.SaveGlobal("Discover");
 
 		if (!ControllerName.empty())
+		{
+			if ((RunMode == RunModes::Normal) && !LockResults.Begin()) RunResults.Begin(FilePath::Qualify(ControllerName));
 			ControlScript.Do(ControllerName, Verbose);
+		}
+
+		ProbeResults.Save();
+		RunResults.Save();
+		LockResults.Save();
 
 		if (RunMode == RunModes::Help)
 		{
@@ -0,0 +1,425 @@
+#include "pkgconfig.h"
+
+#include <fstream>
+#include <functional>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include "shared.h"
+#include "runcache.h"
+
+extern bool Verbose;
+
+// The Debian multiarch directory name for this build, which pkg-config also searches
+static char const *GetMultiarchTriplet(void)
+{
+#if defined(__x86_64__) && defined(__ILP32__)
+	return "x86_64-linux-gnux32";
+#elif defined(__x86_64__)
+	return "x86_64-linux-gnu";
+#elif defined(__i386__)
+	return "i386-linux-gnu";
+#elif defined(__aarch64__)
+	return "aarch64-linux-gnu";
+#elif defined(__arm__) && defined(__ARM_PCS_VFP)
+	return "arm-linux-gnueabihf";
+#elif defined(__arm__)
+	return "arm-linux-gnueabi";
+#elif defined(__powerpc64__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	return "powerpc64le-linux-gnu";
+#elif defined(__s390x__)
+	return "s390x-linux-gnu";
+#elif defined(__riscv) && (__riscv_xlen == 64)
+	return "riscv64-linux-gnu";
+#else
+	return nullptr;
+#endif
+}
+
+static std::vector<String> SplitSearchPath(char const *Raw)
+{
+	std::vector<String> Out;
+	if (Raw == nullptr) return Out;
+	std::queue<String> Parts = StringSplitter(
+#ifdef _WIN32
+			{';'},
+#else
+			{':'},
+#endif
+			true).Process(Raw).Results();
+	while (!Parts.empty())
+	{
+		Out.push_back(Parts.front());
+		Parts.pop();
+	}
+	return Out;
+}
+
+static String Trim(String const &Raw)
+{
+	size_t const Start = Raw.find_first_not_of(" \t");
+	if (Start == String::npos) return String();
+	return Raw.substr(Start, Raw.find_last_not_of(" \t") - Start + 1);
+}
+
+// Replaces ${NAME} with previously defined variables and $$ with $
+static String Expand(std::map<String, String> const &Variables, String const &Raw)
+{
+	String Out;
+	for (size_t Index = 0; Index < Raw.length(); ++Index)
+	{
+		if ((Raw[Index] != '$') || (Index + 1 == Raw.length())) Out += Raw[Index];
+		else if (Raw[Index + 1] == '$')
+		{
+			Out += '$';
+			++Index;
+		}
+		else if (Raw[Index + 1] == '{')
+		{
+			size_t const End = Raw.find('}', Index + 2);
+			if (End == String::npos)
+			{
+				Out += Raw.substr(Index);
+				break;
+			}
+			String const Name = Raw.substr(Index + 2, End - Index - 2);
+			auto Found = Variables.find(Name);
+			if (Found != Variables.end()) Out += Found->second;
+			else if (Verbose) StandardStream << "pkg-config variable " << Name << " is not defined.\n" << OutputStream::Flush();
+			Index = End;
+		}
+		else Out += Raw[Index];
+	}
+	return Out;
+}
+
+// Calls Handle for each -I, -L, and -l argument, whether or not the value is attached
+static void ParseFlags(String const &Raw, std::function<void(char Flag, String const &Value)> const &Handle)
+{
+	std::queue<String> Arguments = StringSplitter({' ', '\t', '\n'}, true).Process(Raw).Results();
+	char Pending = 0;
+	while (!Arguments.empty())
+	{
+		String const Argument = Arguments.front();
+		Arguments.pop();
+		if (Pending != 0)
+		{
+			Handle(Pending, Argument);
+			Pending = 0;
+			continue;
+		}
+		if ((Argument.length() < 2) || (Argument[0] != '-')) continue;
+		if ((Argument[1] != 'I') && (Argument[1] != 'L') && (Argument[1] != 'l')) continue;
+		if (Argument.length() == 2) Pending = Argument[1];
+		else Handle(Argument[1], Argument.substr(2));
+	}
+}
+
+struct Requirement
+{
+	String Name, Operator, Version;
+};
+
+// Reads lists like "glib-2.0 >= 2.40, gobject-2.0"
+static std::vector<Requirement> ParseRequirements(String const &Raw)
+{
+	std::vector<Requirement> Out;
+	auto IsSeparator = [](char Character) { return (Character == ' ') || (Character == '\t') || (Character == ','); };
+	auto IsOperator = [](char Character) { return (Character == '<') || (Character == '>') || (Character == '=') || (Character == '!'); };
+	size_t Index = 0;
+	auto Read = [&](std::function<bool(char)> const &Continue)
+	{
+		size_t const Start = Index;
+		while ((Index < Raw.length()) && Continue(Raw[Index])) ++Index;
+		return Raw.substr(Start, Index - Start);
+	};
+	auto SkipSpace = [&](void) { Read([](char Character) { return (Character == ' ') || (Character == '\t'); }); };
+	while (true)
+	{
+		Read(IsSeparator);
+		if (Index == Raw.length()) break;
+		Requirement Next;
+		Next.Name = Read([&](char Character) { return !IsSeparator(Character) && !IsOperator(Character); });
+		SkipSpace();
+		if ((Index < Raw.length()) && IsOperator(Raw[Index]))
+		{
+			Next.Operator = Read(IsOperator);
+			SkipSpace();
+			Next.Version = Read([&](char Character) { return !IsSeparator(Character); });
+		}
+		if (!Next.Name.empty()) Out.push_back(Next);
+	}
+	return Out;
+}
+
+// Compares versions segment by segment the way rpm (and so pkg-config) does
+static int CompareVersions(String const &First, String const &Second)
+{
+	size_t FirstIndex = 0, SecondIndex = 0;
+	while (true)
+	{
+		while ((FirstIndex < First.length()) && !isalnum(First[FirstIndex])) ++FirstIndex;
+		while ((SecondIndex < Second.length()) && !isalnum(Second[SecondIndex])) ++SecondIndex;
+		if ((FirstIndex == First.length()) || (SecondIndex == Second.length())) break;
+		bool const Numeric = isdigit(First[FirstIndex]);
+		auto Segment = [Numeric](String const &Version, size_t &Index)
+		{
+			size_t const Start = Index;
+			while ((Index < Version.length()) && (Numeric ? isdigit(Version[Index]) : isalpha(Version[Index]))) ++Index;
+			return Version.substr(Start, Index - Start);
+		};
+		String FirstSegment = Segment(First, FirstIndex), SecondSegment = Segment(Second, SecondIndex);
+		// Numbers are newer than letters
+		if (SecondSegment.empty()) return Numeric ? 1 : -1;
+		if (Numeric)
+		{
+			FirstSegment.erase(0, std::min(FirstSegment.find_first_not_of('0'), FirstSegment.length()));
+			SecondSegment.erase(0, std::min(SecondSegment.find_first_not_of('0'), SecondSegment.length()));
+			if (FirstSegment.length() != SecondSegment.length()) return FirstSegment.length() < SecondSegment.length() ? -1 : 1;
+		}
+		int const Comparison = FirstSegment.compare(SecondSegment);
+		if (Comparison != 0) return Comparison < 0 ? -1 : 1;
+	}
+	if ((FirstIndex == First.length()) && (SecondIndex == Second.length())) return 0;
+	return FirstIndex == First.length() ? -1 : 1;
+}
+
+static bool Satisfies(String const &Version, String const &Operator, String const &Required)
+{
+	int const Comparison = CompareVersions(Version, Required);
+	if (Operator == "=") return Comparison == 0;
+	if (Operator == "!=") return Comparison != 0;
+	if (Operator == "<") return Comparison < 0;
+	if (Operator == "<=") return Comparison <= 0;
+	if (Operator == ">") return Comparison > 0;
+	if (Operator == ">=") return Comparison >= 0;
+	return false;
+}
+
+PackageConfig::PackageConfig(void) : Prepared(false) {}
+
+void PackageConfig::Prepare(void)
+{
+	if (Prepared) return;
+	Prepared = true;
+
+	char const *RootVariable = getenv("PKG_CONFIG_SYSROOT_DIR");
+	if (RootVariable != nullptr) SystemRoot = RootVariable;
+	while ((SystemRoot.length() > 0) && (SystemRoot[SystemRoot.length() - 1] == '/')) SystemRoot.erase(SystemRoot.length() - 1);
+
+	std::vector<String> Search = SplitSearchPath(getenv("PKG_CONFIG_PATH"));
+	char const *LibraryVariable = getenv("PKG_CONFIG_LIBDIR");
+	if (LibraryVariable != nullptr)
+	{
+		auto Parts = SplitSearchPath(LibraryVariable);
+		Search.insert(Search.end(), Parts.begin(), Parts.end());
+	}
+#ifndef _WIN32
+	else
+	{
+		char const *Triplet = GetMultiarchTriplet();
+		for (String const Prefix : {"/usr/local", "/usr"})
+		{
+			if (Triplet != nullptr) Search.push_back(Prefix + "/lib/" + Triplet + "/pkgconfig");
+			Search.push_back(Prefix + "/lib64/pkgconfig");
+			Search.push_back(Prefix + "/lib/pkgconfig");
+			Search.push_back(Prefix + "/share/pkgconfig");
+		}
+	}
+#endif
+	for (auto &Location : Search)
+		SearchDirectories.emplace_back(DirectoryPath::Qualify(Location));
+
+	// Like pkg-config, leave out directories the compiler and linker search anyway
+	if (getenv("PKG_CONFIG_ALLOW_SYSTEM_CFLAGS") == nullptr)
+	{
+		auto Parts = SplitSearchPath(getenv("PKG_CONFIG_SYSTEM_INCLUDE_PATH"));
+		if (Parts.empty()) Parts.push_back("/usr/include");
+		SystemIncludeDirectories.insert(Parts.begin(), Parts.end());
+	}
+	if (getenv("PKG_CONFIG_ALLOW_SYSTEM_LIBS") == nullptr)
+	{
+		auto Parts = SplitSearchPath(getenv("PKG_CONFIG_SYSTEM_LIBRARY_PATH"));
+		if (Parts.empty())
+		{
+			char const *Triplet = GetMultiarchTriplet();
+			for (String const Prefix : {"/usr", ""})
+			{
+				Parts.push_back(Prefix + "/lib");
+				Parts.push_back(Prefix + "/lib64");
+				if (Triplet != nullptr) Parts.push_back(Prefix + "/lib/" + Triplet);
+			}
+		}
+		SystemLibraryDirectories.insert(Parts.begin(), Parts.end());
+	}
+
+	if (Verbose)
+	{
+		StandardStream << "Checking the following directories for pkg-config files:\n";
+		for (auto &Location : SearchDirectories)
+			StandardStream << "\t" << Location.GetDirectory() << "\n";
+		StandardStream << OutputStream::Flush();
+	}
+}
+
+PackageConfig::Package &PackageConfig::Load(String const &Name)
+{
+	auto Found = Packages.find(Name);
+	if (Found != Packages.end()) return Found->second;
+	Package &Out = Packages[Name];
+	Out.Found = false;
+
+	Prepare();
+	for (auto &Directory : SearchDirectories)
+	{
+		String const Filename = Name + ".pc";
+		if (!Directory.Contains(Filename)) continue;
+		FilePath const Location = Directory.GetDirectory().Select(Filename);
+		RecordDependency(Location.AsAbsoluteString());
+		std::ifstream Input(Location.AsAbsoluteString().c_str());
+		if (!Input) continue;
+		if (Verbose) StandardStream << "Reading pkg-config file " << Location << "\n" << OutputStream::Flush();
+		Out.Found = true;
+
+		String FileDirectory = Location.Directory().AsAbsoluteString();
+		while ((FileDirectory.length() > 1) && (FileDirectory[FileDirectory.length() - 1] == '/')) FileDirectory.erase(FileDirectory.length() - 1);
+		Out.Variables["pcfiledir"] = FileDirectory;
+		Out.Variables["pc_sysrootdir"] = SystemRoot.empty() ? String("/") : SystemRoot;
+
+		auto ParseLine = [&](String const &Line)
+		{
+			// Comments run from an unescaped # to the end of the line
+			String Text;
+			for (size_t Index = 0; Index < Line.length(); ++Index)
+			{
+				if ((Line[Index] == '\\') && (Index + 1 < Line.length()) && (Line[Index + 1] == '#'))
+				{
+					Text += '#';
+					++Index;
+				}
+				else if (Line[Index] == '#') break;
+				else Text += Line[Index];
+			}
+
+			size_t const Start = Text.find_first_not_of(" \t");
+			if (Start == String::npos) return;
+			size_t End = Start;
+			while ((End < Text.length()) && (isalnum(Text[End]) || (Text[End] == '_') || (Text[End] == '.'))) ++End;
+			if (End == Start) return;
+			String Key = Text.substr(Start, End - Start);
+			size_t const Separator = Text.find_first_not_of(" \t", End);
+			if (Separator == String::npos) return;
+			String const Value = Expand(Out.Variables, Trim(Text.substr(Separator + 1)));
+			if (Text[Separator] == '=') Out.Variables[Key] = Value;
+			else if (Text[Separator] == ':')
+			{
+				for (auto &Character : Key) Character = tolower(Character);
+				Out.Fields[Key] = Value;
+			}
+		};
+
+		String Line, Continued;
+		while (std::getline(Input, Line))
+		{
+			if (!Line.empty() && (Line[Line.length() - 1] == '\r')) Line.erase(Line.length() - 1);
+			if (!Line.empty() && (Line[Line.length() - 1] == '\\'))
+			{
+				Continued += Line.substr(0, Line.length() - 1);
+				continue;
+			}
+			ParseLine(Continued + Line);
+			Continued.clear();
+		}
+		if (!Continued.empty()) ParseLine(Continued);
+		break;
+	}
+	if (!Out.Found && Verbose) StandardStream << "No pkg-config file for package " << Name << "\n" << OutputStream::Flush();
+	return Out;
+}
+
+static String GetField(std::map<String, String> const &Fields, String const &Key)
+{
+	auto Found = Fields.find(Key);
+	if (Found == Fields.end()) return String();
+	return Found->second;
+}
+
+void PackageConfig::AddDirectory(std::vector<String> &Directories, std::set<String> const &SystemDirectories, String const &Directory) const
+{
+	if (Directory.empty() || (SystemDirectories.count(Directory) != 0)) return;
+	String const Rooted = (!SystemRoot.empty() && (Directory[0] == '/')) ? SystemRoot + Directory : Directory;
+	if (std::find(Directories.begin(), Directories.end(), Rooted) == Directories.end()) Directories.push_back(Rooted);
+}
+
+bool PackageConfig::Collect(String const &Name, bool Static, bool WithLibraries, std::map<String, bool> &Visited, std::vector<String> &Finished, Result &Out)
+{
+	auto Seen = Visited.find(Name);
+	bool const FirstVisit = Seen == Visited.end();
+	if (!FirstVisit && (Seen->second || !WithLibraries)) return true;
+	Visited[Name] = WithLibraries;
+
+	Package &Source = Load(Name);
+	if (!Source.Found) return false;
+	if (FirstVisit)
+	{
+		ParseFlags(GetField(Source.Fields, "cflags"), [&](char Flag, String const &Value)
+			{ if (Flag == 'I') AddDirectory(Out.IncludeDirectories, SystemIncludeDirectories, Value); });
+	}
+
+	auto Require = [&](String const &Raw, bool RequireLibraries)
+	{
+		for (auto &Next : ParseRequirements(Raw))
+		{
+			Package &Dependency = Load(Next.Name);
+			if (!Dependency.Found)
+			{
+				if (Verbose) StandardStream << "pkg-config package " << Name << " requires missing package " << Next.Name << "\n" << OutputStream::Flush();
+				return false;
+			}
+			String const Version = GetField(Dependency.Fields, "version");
+			if (!Next.Operator.empty() && !Satisfies(Version, Next.Operator, Next.Version))
+			{
+				if (Verbose) StandardStream << "pkg-config package " << Name << " requires " << Next.Name << " " << Next.Operator << " " << Next.Version << " but version " << Version << " is installed\n" << OutputStream::Flush();
+				return false;
+			}
+			if (!Collect(Next.Name, Static, RequireLibraries, Visited, Finished, Out)) return false;
+		}
+		return true;
+	};
+	// Private requirements' headers may be included by this package's headers, so their include flags are always used
+	if (!Require(GetField(Source.Fields, "requires"), WithLibraries) ||
+		!Require(GetField(Source.Fields, "requires.private"), WithLibraries && Static)) return false;
+	if (FirstVisit) Finished.push_back(Name);
+	return true;
+}
+
+bool PackageConfig::Resolve(String const &Name, bool Static, Result &Out)
+{
+	Result Collected;
+	std::map<String, bool> Visited;
+	std::vector<String> Finished;
+	if (!Collect(Name, Static, true, Visited, Finished, Collected)) return false;
+
+	// Every package comes before the packages it requires, so the libraries are in link order
+	for (auto Current = Finished.rbegin(); Current != Finished.rend(); ++Current)
+	{
+		if (!Visited[*Current]) continue;
+		auto HandleFlag = [&](char Flag, String const &Value)
+		{
+			if (Flag == 'L') AddDirectory(Collected.LibraryDirectories, SystemLibraryDirectories, Value);
+			else if ((Flag == 'l') && !Value.empty())
+			{
+				// Keep the last mention in case a package names its requirements' libraries itself
+				Collected.Libraries.erase(std::remove(Collected.Libraries.begin(), Collected.Libraries.end(), Value), Collected.Libraries.end());
+				Collected.Libraries.push_back(Value);
+			}
+		};
+		Package const &Source = Packages[*Current];
+		ParseFlags(GetField(Source.Fields, "libs"), HandleFlag);
+		if (Static) ParseFlags(GetField(Source.Fields, "libs.private"), HandleFlag);
+	}
+	Out = Collected;
+	return true;
+}
+
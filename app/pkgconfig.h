@@ -0,0 +1,46 @@
+#ifndef PKGCONFIG_H
+#define PKGCONFIG_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "ren-general/string.h"
+#include "ren-general/filesystem.h"
+#include "directoryindex.h"
+
+// Reads pkg-config .pc files directly, so packages can be resolved without starting pkg-config.  The search path, PKG_CONFIG_SYSROOT_DIR, and the system directory filtering follow pkg-config's environment variables.
+class PackageConfig
+{
+	public:
+		struct Result
+		{
+			std::vector<String> IncludeDirectories, LibraryDirectories, Libraries;
+		};
+
+		PackageConfig(void);
+		// Collects the flags for package Name and everything it requires, including Libs.private and private requirements if Static is set; returns false if the package or one of its requirements is missing
+		bool Resolve(String const &Name, bool Static, Result &Out);
+
+	private:
+		struct Package
+		{
+			bool Found;
+			std::map<String, String> Variables, Fields; // Field names are lowercase
+		};
+
+		void Prepare(void);
+		Package &Load(String const &Name);
+		// Walks the requirements depth first, collecting include directories; Visited records whether each package's libraries are needed and Finished lists packages after their requirements
+		bool Collect(String const &Name, bool Static, bool WithLibraries, std::map<String, bool> &Visited, std::vector<String> &Finished, Result &Out);
+		void AddDirectory(std::vector<String> &Directories, std::set<String> const &SystemDirectories, String const &Directory) const;
+
+		bool Prepared;
+		std::vector<DirectoryIndex> SearchDirectories;
+		std::set<String> SystemIncludeDirectories, SystemLibraryDirectories;
+		String SystemRoot;
+		std::map<String, Package> Packages;
+};
+
+#endif // PKGCONFIG_H
+
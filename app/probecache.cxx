@@ -0,0 +1,224 @@
+#include "probecache.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "shared.h"
+#include "configuration.h"
+#include "runcache.h"
+
+extern bool Verbose;
+
+String const CacheFormat = "selfdiscovery-probecache 1";
+
+String FingerprintFile(FilePath const &File) { return FingerprintPath(File.AsAbsoluteString()); }
+
+String FingerprintPath(String const &Path)
+{
+	struct stat Status;
+	if (stat(Path.c_str(), &Status) == -1) return String();
+	MemoryStream Out;
+	Out << Path << ":" << Status.st_ino << ":" << Status.st_size << ":" << Status.st_mtime;
+#ifdef __linux__
+	Out << "." << Status.st_mtim.tv_nsec;
+#endif
+	return Out;
+}
+
+String HashString(String const &Contents)
+{
+	// 64-bit FNV-1a
+	uint64_t Hash = 14695981039346656037ULL;
+	for (char const Character : Contents)
+	{
+		Hash ^= static_cast<unsigned char>(Character);
+		Hash *= 1099511628211ULL;
+	}
+	char Out[17];
+	snprintf(Out, sizeof(Out), "%016llx", static_cast<unsigned long long>(Hash));
+	return Out;
+}
+
+String EscapeCacheField(String const &Raw)
+{
+	String Out;
+	Out.reserve(Raw.length());
+	for (char const Character : Raw)
+	{
+		if (Character == '\\') Out += "\\\\";
+		else if (Character == '\t') Out += "\\t";
+		else if (Character == '\n') Out += "\\n";
+		else Out += Character;
+	}
+	return Out;
+}
+
+String UnescapeCacheField(String const &Escaped)
+{
+	String Out;
+	Out.reserve(Escaped.length());
+	for (size_t Index = 0; Index < Escaped.length(); ++Index)
+	{
+		if ((Escaped[Index] != '\\') || (Index + 1 == Escaped.length()))
+		{
+			Out += Escaped[Index];
+			continue;
+		}
+		++Index;
+		if (Escaped[Index] == 't') Out += '\t';
+		else if (Escaped[Index] == 'n') Out += '\n';
+		else Out += Escaped[Index];
+	}
+	return Out;
+}
+
+bool ReplaceCacheFile(FilePath const &Location, String const &Contents)
+{
+	String const FinalPath = Location.AsAbsoluteString();
+#ifdef _WIN32
+	String const TemporaryPath = FinalPath + "." + AsString(_getpid()) + ".new";
+#else
+	String const TemporaryPath = FinalPath + "." + AsString(getpid()) + ".new";
+#endif
+	{
+		std::ofstream Output(TemporaryPath.c_str(), std::ios::out | std::ios::trunc);
+		Output << Contents;
+		if (!Output.flush())
+		{
+			std::remove(TemporaryPath.c_str());
+			return false;
+		}
+	}
+	if (std::rename(TemporaryPath.c_str(), FinalPath.c_str()) != 0)
+	{
+		std::remove(TemporaryPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+static bool SplitPair(String const &Line, String &First, String &Second)
+{
+	size_t const Tab = Line.find('\t', 2);
+	if (Tab == String::npos) return false;
+	First = UnescapeCacheField(Line.substr(2, Tab - 2));
+	Second = UnescapeCacheField(Line.substr(Tab + 1));
+	return true;
+}
+
+ProbeCache::ProbeCache(FilePath const &Location) : Location(Location), Prepared(false), Enabled(false), Changed(false) {}
+
+ProbeCache::~ProbeCache(void) { Save(); }
+
+bool ProbeCache::Prepare(void)
+{
+	if (Prepared) return Enabled;
+	Prepared = true;
+	if (FindConfiguration("NoProbeCache").first)
+	{
+		if (Verbose) StandardStream << "Probe cache disabled by configuration.\n" << OutputStream::Flush();
+		return false;
+	}
+	Enabled = true;
+
+	std::ifstream Input(Location.AsAbsoluteString().c_str());
+	String Line;
+	if (!std::getline(Input, Line) || (Line != CacheFormat))
+	{
+		if (Verbose) StandardStream << "No usable probe cache at " << Location << ".\n" << OutputStream::Flush();
+		return true;
+	}
+
+	SubjectResults *Current = nullptr;
+	while (std::getline(Input, Line))
+	{
+		String First, Second;
+		if ((Line.length() < 2) || !SplitPair(Line, First, Second)) continue;
+		if (Line[0] == 'S')
+		{
+			Current = &Subjects[First];
+			Current->Fingerprint = Second;
+		}
+		else if ((Line[0] == 'R') && (Current != nullptr))
+			Current->Results[First] = Second;
+	}
+	if (Verbose) StandardStream << "Loaded probe results for " << Subjects.size() << " files from " << Location << ".\n" << OutputStream::Flush();
+	return true;
+}
+
+String const &ProbeCache::GetFingerprint(FilePath const &Subject)
+{
+	String const Path = Subject.AsAbsoluteString();
+	auto Found = Fingerprints.find(Path);
+	if (Found == Fingerprints.end())
+		Found = Fingerprints.insert(std::make_pair(Path, FingerprintFile(Subject))).first;
+	return Found->second;
+}
+
+std::pair<bool, String> ProbeCache::Find(FilePath const &Subject, String const &Query)
+{
+	// Whatever was probed, the answer depends on the subject, cached or not
+	RecordDependency(Subject.AsAbsoluteString());
+	if (!Prepare()) return std::pair<bool, String>(false, String());
+
+	String const &Fingerprint = GetFingerprint(Subject);
+	auto FoundSubject = Subjects.find(Subject.AsAbsoluteString());
+	if ((FoundSubject != Subjects.end()) && (FoundSubject->second.Fingerprint != Fingerprint))
+	{
+		if (Verbose) StandardStream << "Cached probe results for " << Subject << " are out of date.\n" << OutputStream::Flush();
+		Subjects.erase(FoundSubject);
+		Changed = true;
+		FoundSubject = Subjects.end();
+	}
+	if (!Fingerprint.empty() && (FoundSubject != Subjects.end()))
+	{
+		auto FoundResult = FoundSubject->second.Results.find(Query);
+		if (FoundResult != FoundSubject->second.Results.end())
+		{
+			if (Verbose) StandardStream << "Probe cache hit for " << Subject << ": " << Query << "\n" << OutputStream::Flush();
+			return std::pair<bool, String>(true, FoundResult->second);
+		}
+	}
+	if (Verbose) StandardStream << "Probe cache miss for " << Subject << ": " << Query << "\n" << OutputStream::Flush();
+	return std::pair<bool, String>(false, String());
+}
+
+void ProbeCache::Store(FilePath const &Subject, String const &Query, String const &Value)
+{
+	if (!Prepare()) return;
+	String const &Fingerprint = GetFingerprint(Subject);
+	if (Fingerprint.empty()) return;
+	SubjectResults &Results = Subjects[Subject.AsAbsoluteString()];
+	Results.Fingerprint = Fingerprint;
+	Results.Results[Query] = Value;
+	Changed = true;
+}
+
+FilePath const &ProbeCache::GetLocation(void) const { return Location; }
+
+void ProbeCache::Save(void)
+{
+	if (!Changed) return;
+	Changed = false;
+
+	try { Location.Directory().Create(true); }
+	catch (...) {}
+
+	MemoryStream Output;
+	Output << CacheFormat << "\n";
+	for (auto &Subject : Subjects)
+	{
+		Output << "S " << EscapeCacheField(Subject.first) << "\t" << EscapeCacheField(Subject.second.Fingerprint) << "\n";
+		for (auto &Result : Subject.second.Results)
+			Output << "R " << EscapeCacheField(Result.first) << "\t" << EscapeCacheField(Result.second) << "\n";
+	}
+	if (!ReplaceCacheFile(Location, Output) && Verbose) StandardStream << "Couldn't replace probe cache " << Location << ".\n" << OutputStream::Flush();
+}
+
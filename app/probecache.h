@@ -0,0 +1,46 @@
+#ifndef PROBECACHE_H
+#define PROBECACHE_H
+
+#include <map>
+
+#include "ren-general/string.h"
+#include "ren-general/filesystem.h"
+
+String FingerprintFile(FilePath const &File); // Path, inode, size, and modification time; empty if the file can't be examined
+String FingerprintPath(String const &Path); // The same, for files and directories named by absolute path
+String HashString(String const &Contents);
+// For one-line fields in cache files; tabs and newlines are escaped
+String EscapeCacheField(String const &Raw);
+String UnescapeCacheField(String const &Escaped);
+// Writes Contents beside Location under a name unique to this process, then renames it over Location, so concurrent runs never read a partial file or write into each other's; returns false if either step failed
+bool ReplaceCacheFile(FilePath const &Location, String const &Contents);
+
+// Remembers probe results between runs.  Results are stored per subject file (a compiler executable, for instance) and are all forgotten as soon as the subject's fingerprint changes.
+class ProbeCache
+{
+	public:
+		ProbeCache(FilePath const &Location);
+		~ProbeCache(void); // Saves
+		std::pair<bool, String> Find(FilePath const &Subject, String const &Query);
+		void Store(FilePath const &Subject, String const &Query, String const &Value);
+		void Save(void);
+		FilePath const &GetLocation(void) const;
+
+	private:
+		bool Prepare(void); // Loads the cache file on first use; returns false if caching is disabled
+		String const &GetFingerprint(FilePath const &Subject);
+
+		FilePath const Location;
+		bool Prepared, Enabled, Changed;
+		std::map<String, String> Fingerprints; // Per run, so each subject is examined once
+
+		struct SubjectResults
+		{
+			String Fingerprint;
+			std::map<String, String> Results;
+		};
+		std::map<String, SubjectResults> Subjects;
+};
+
+#endif // PROBECACHE_H
+
@@ -0,0 +1,494 @@
+#include "runcache.h"
+
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#ifndef WINDOWS
+#include <atomic>
+#include <thread>
+#include <system_error>
+#endif
+
+#include "shared.h"
+#include "configuration.h"
+#include "probecache.h"
+#include "information.h"
+
+extern char **environ;
+extern RunCache RunResults;
+extern LockFile LockResults;
+extern bool Verbose;
+
+String const RunCacheFormat = "selfdiscovery-runcache 2";
+String const LockFormat = "selfdiscovery-lock 1";
+
+void RecordDependency(String const &Path)
+{
+	String Normalized = Path;
+	while ((Normalized.length() > 1) && (Normalized[Normalized.length() - 1] == '/')) Normalized.erase(Normalized.length() - 1);
+	RunResults.AddDependency(Normalized);
+	LockResults.AddDependency(Normalized);
+	DependencyScope::Note(Normalized);
+}
+
+DependencyScope *DependencyScope::Current = nullptr;
+
+DependencyScope::DependencyScope(std::set<String> &Paths) : Paths(Paths), Outer(Current) { Current = this; }
+
+DependencyScope::~DependencyScope(void) { Current = Outer; }
+
+void DependencyScope::Note(String const &Path)
+{
+	for (DependencyScope *Scope = Current; Scope != nullptr; Scope = Scope->Outer)
+		Scope->Paths.insert(Path);
+}
+
+void DependencyScope::Note(std::set<String> const &Paths)
+{
+	for (DependencyScope *Scope = Current; Scope != nullptr; Scope = Scope->Outer)
+		if (&Scope->Paths != &Paths) Scope->Paths.insert(Paths.begin(), Paths.end());
+}
+
+// The controller may change its queries based on any of these, and the items read the environment variables
+static void DescribeSettings(MemoryStream &KeySource, std::set<String> const &Ignored)
+{
+	for (auto &Setting : GetProgramConfiguration())
+		if (Ignored.find(Setting.first) == Ignored.end())
+			KeySource << "C " << Setting.first << "=" << Setting.second.Value << "\n";
+	std::map<String, String> Environment;
+	for (char **Variable = environ; *Variable != nullptr; ++Variable)
+	{
+		String const Line = *Variable;
+		String const Name = Line.substr(0, Line.find('='));
+		if ((Name == "PATH") || (Name.compare(0, 11, "PKG_CONFIG_") == 0) ||
+			((Name.compare(0, 10, "LD_LIBRARY") == 0) && (Name.length() >= 15) && (Name.compare(Name.length() - 5, 5, "_PATH") == 0)))
+			Environment[Name] = Line;
+	}
+	for (auto &Variable : Environment) KeySource << "E " << Variable.second << "\n";
+}
+
+// Each fingerprint is a separate stat, and a lock can have hundreds, so they're taken on a few threads
+static void FingerprintAll(std::vector<String> const &Paths, std::vector<String> &Out)
+{
+	Out.assign(Paths.size(), String());
+#ifndef WINDOWS
+	size_t const MaximumThreads = 8;
+	if (Paths.size() > 1)
+	{
+		std::atomic<size_t> Next(0);
+		auto Work = [&](void)
+		{
+			for (size_t Index = Next++; Index < Paths.size(); Index = Next++)
+				Out[Index] = FingerprintPath(Paths[Index]);
+		};
+		std::vector<std::thread> Threads;
+		try
+		{
+			for (size_t Count = 1; Count < std::min(Paths.size(), MaximumThreads); ++Count)
+				Threads.emplace_back(Work);
+		}
+		catch (std::system_error &) {} // The threads that did start, and this one, still finish the list
+		Work();
+		for (auto &Thread : Threads) Thread.join();
+		return;
+	}
+#endif
+	for (size_t Index = 0; Index < Paths.size(); ++Index)
+		Out[Index] = FingerprintPath(Paths[Index]);
+}
+
+// Steps separated by tabs, each a letter for the operation followed by its escaped value
+static String SerializeResponse(Response const &Result)
+{
+	MemoryStream Out;
+	bool First = true;
+	for (auto &Current : Result.Steps)
+	{
+		if (!First) Out << "\t";
+		First = false;
+		switch (Current.Operation)
+		{
+			case Response::Operations::Table: Out << "T"; break;
+			case Response::Operations::String: Out << "S" << EscapeCacheField(Current.Text); break;
+			case Response::Operations::Integer: Out << "I" << Current.Number; break;
+			case Response::Operations::Boolean: Out << "B" << Current.Number; break;
+			case Response::Operations::Element: Out << "E" << EscapeCacheField(Current.Text); break;
+			case Response::Operations::Index: Out << "N" << Current.Number; break;
+		}
+	}
+	return Out;
+}
+
+static bool DeserializeResponse(String const &Serialized, Response &Out)
+{
+	for (size_t Start = 0; Start < Serialized.length(); )
+	{
+		size_t End = Serialized.find('\t', Start);
+		if (End == String::npos) End = Serialized.length();
+		String const Field = Serialized.substr(Start, End - Start);
+		Start = End + 1;
+		if (Field.empty()) return false;
+		String const Value = Field.substr(1);
+		switch (Field[0])
+		{
+			case 'T': Out.Steps.push_back(Response::Step{Response::Operations::Table, String(), 0}); break;
+			case 'S': Out.Steps.push_back(Response::Step{Response::Operations::String, UnescapeCacheField(Value), 0}); break;
+			case 'I': Out.Steps.push_back(Response::Step{Response::Operations::Integer, String(), strtol(Value.c_str(), nullptr, 10)}); break;
+			case 'B': Out.Steps.push_back(Response::Step{Response::Operations::Boolean, String(), strtol(Value.c_str(), nullptr, 10)}); break;
+			case 'E': Out.Steps.push_back(Response::Step{Response::Operations::Element, UnescapeCacheField(Value), 0}); break;
+			case 'N': Out.Steps.push_back(Response::Step{Response::Operations::Index, String(), strtol(Value.c_str(), nullptr, 10)}); break;
+			default: return false;
+		}
+	}
+	return true;
+}
+
+static bool SplitPair(String const &Line, String &First, String &Second)
+{
+	size_t const Tab = Line.find('\t', 2);
+	if (Tab == String::npos) return false;
+	First = UnescapeCacheField(Line.substr(2, Tab - 2));
+	Second = UnescapeCacheField(Line.substr(Tab + 1));
+	return true;
+}
+
+// The run cache has a section per controller, starting with a C line naming it; returns each section's lines by controller
+static std::map<String, String> ReadRunCacheSections(FilePath const &Location)
+{
+	std::map<String, String> Out;
+	std::ifstream Input(Location.AsAbsoluteString().c_str());
+	String Line;
+	if (!std::getline(Input, Line) || (Line != RunCacheFormat)) return Out;
+	String *Section = nullptr;
+	while (std::getline(Input, Line))
+	{
+		if ((Line.length() >= 2) && (Line[0] == 'C')) Section = &Out[UnescapeCacheField(Line.substr(2))];
+		else if (Section != nullptr) *Section += Line + "\n";
+	}
+	return Out;
+}
+
+RunCache::RunCache(FilePath const &Location) : Location(Location), Enabled(false), Changed(false) {}
+
+void RunCache::Begin(FilePath const &Controller)
+{
+	if (FindConfiguration("NoRunCache").first)
+	{
+		if (Verbose) StandardStream << "Run cache disabled by configuration.\n" << OutputStream::Flush();
+		return;
+	}
+	Enabled = true;
+	this->Controller = Controller.AsAbsoluteString();
+
+	MemoryStream KeySource;
+	KeySource << RunCacheFormat << "\n" << this->Controller << "\n";
+	{
+		std::ifstream Input(Controller.AsAbsoluteString().c_str(), std::ios::in | std::ios::binary);
+		KeySource << String(std::istreambuf_iterator<char>(Input), std::istreambuf_iterator<char>()) << "\n";
+	}
+	DescribeSettings(KeySource, {});
+#ifdef __linux__
+	// CPU and memory topology aren't files with meaningful fingerprints, but they rarely change without a reboot.  Items reading state that changes more often, like Parallelism, are never replayed.
+	{
+		std::ifstream Input("/proc/sys/kernel/random/boot_id");
+		String Boot;
+		std::getline(Input, Boot);
+		KeySource << "B " << Boot << "\n";
+	}
+	// Affinity is set per process, by taskset or a container's CPU set
+	cpu_set_t Affinity;
+	if (sched_getaffinity(0, sizeof(Affinity), &Affinity) == 0)
+	{
+		KeySource << "A";
+		for (int CPU = 0; CPU < CPU_SETSIZE; ++CPU)
+			if (CPU_ISSET(CPU, &Affinity)) KeySource << " " << CPU;
+		KeySource << "\n";
+	}
+#endif
+	Key = HashString(KeySource);
+
+	std::map<String, String> const Sections = ReadRunCacheSections(Location);
+	auto Section = Sections.find(this->Controller);
+	std::istringstream Input(Section == Sections.end() ? String() : Section->second);
+	String Line;
+	if (!std::getline(Input, Line) || (Line != "K " + Key))
+	{
+		if (Verbose) StandardStream << "No usable run of this controller in the run cache at " << Location << ".\n" << OutputStream::Flush();
+		return;
+	}
+	std::map<String, String> LoadedDependencies;
+	std::vector<Query> Loaded;
+	while (std::getline(Input, Line))
+	{
+		if (Line.length() < 2) continue;
+		String First, Second;
+		if (Line[0] == 'D')
+		{
+			if (SplitPair(Line, First, Second)) LoadedDependencies[First] = Second;
+		}
+		else if (Line[0] == 'Q') Loaded.push_back(Query{UnescapeCacheField(Line.substr(2)), {}, String(), false});
+		else if ((Line[0] == 'A') && !Loaded.empty())
+		{
+			if (SplitPair(Line, First, Second)) Loaded.back().Arguments.push_back(std::make_pair(First, Second));
+		}
+		else if ((Line[0] == 'R') && !Loaded.empty()) Loaded.back().Serialized = Line.substr(2);
+	}
+	for (auto &Dependency : LoadedDependencies)
+		if (FingerprintPath(Dependency.first) != Dependency.second)
+		{
+			if (Verbose) StandardStream << "The run cache at " << Location << " is out of date because \"" << Dependency.first << "\" changed.\n" << OutputStream::Flush();
+			return;
+		}
+	if (Verbose) StandardStream << "Loaded " << Loaded.size() << " recorded queries from " << Location << ".\n" << OutputStream::Flush();
+	Recorded.swap(Loaded);
+	Dependencies.swap(LoadedDependencies);
+}
+
+bool RunCache::Find(String const &Identifier, QueryState &State, Response &Result)
+{
+	if (!Enabled || Recorded.empty()) return false;
+	for (auto &Candidate : Recorded)
+	{
+		if (Candidate.Used || (Candidate.Identifier != Identifier)) continue;
+		Result.Steps.clear();
+		if (!State.MatchArguments(Candidate.Arguments) || !DeserializeResponse(Candidate.Serialized, Result)) continue;
+		Candidate.Used = true;
+		Queries.push_back(Candidate);
+		if (Verbose) StandardStream << "Answered Discover." << Identifier << " from the run cache.\n" << OutputStream::Flush();
+		return true;
+	}
+	// The controller asked for something the recorded run didn't, so the recording has to be redone
+	if (Verbose) StandardStream << "The run cache has no answer for this Discover." << Identifier << " query.\n" << OutputStream::Flush();
+	Changed = true;
+	return false;
+}
+
+void RunCache::Record(String const &Identifier, QueryState const &State)
+{
+	if (!Enabled) return;
+	Queries.push_back(Query{Identifier, State.GetArguments(), SerializeResponse(State.GetResponse()), true});
+	Changed = true;
+}
+
+void RunCache::AddDependency(String const &Path)
+{
+	if (!Enabled || (Dependencies.find(Path) != Dependencies.end())) return;
+	Dependencies[Path] = FingerprintPath(Path);
+}
+
+void RunCache::Save(void)
+{
+	if (!Enabled || !Changed) return;
+	Changed = false;
+
+	try { Location.Directory().Create(true); }
+	catch (...) {}
+
+	MemoryStream Section;
+	Section << "K " << Key << "\n";
+	for (auto &Dependency : Dependencies)
+		Section << "D " << EscapeCacheField(Dependency.first) << "\t" << EscapeCacheField(Dependency.second) << "\n";
+	for (auto &Current : Queries)
+	{
+		Section << "Q " << EscapeCacheField(Current.Identifier) << "\n";
+		for (auto &Argument : Current.Arguments)
+			Section << "A " << EscapeCacheField(Argument.first) << "\t" << EscapeCacheField(Argument.second) << "\n";
+		Section << "R " << Current.Serialized << "\n";
+	}
+
+	// Other controllers' sections are read again, to keep what runs of them saved since this run began, and dropped once their controllers are gone
+	std::map<String, String> Sections = ReadRunCacheSections(Location);
+	Sections[Controller] = Section;
+	MemoryStream Output;
+	Output << RunCacheFormat << "\n";
+	for (auto &Current : Sections)
+	{
+		if ((Current.first != Controller) && FingerprintPath(Current.first).empty()) continue;
+		Output << "C " << EscapeCacheField(Current.first) << "\n" << Current.second;
+	}
+	if (!ReplaceCacheFile(Location, Output))
+	{
+		if (Verbose) StandardStream << "Couldn't replace run cache " << Location << ".\n" << OutputStream::Flush();
+	}
+	else if (Verbose) StandardStream << "Recorded " << Queries.size() << " queries and " << Dependencies.size() << " dependencies in " << Location << ".\n" << OutputStream::Flush();
+}
+
+FilePath const &RunCache::GetLocation(void) const { return Location; }
+
+LockFile::LockFile(FilePath const &Location) : Location(Location), Recording(false), Using(false) {}
+
+bool LockFile::Begin(void)
+{
+	Recording = FindConfiguration("Lock").first;
+	Using = FindConfiguration("UseLock").first;
+	if (!Recording && !Using) return false;
+
+	// Switches that don't change the answers are left out, so a lock made with Lock can be used with UseLock
+	MemoryStream KeySource;
+	KeySource << LockFormat << "\n";
+	DescribeSettings(KeySource, {"Lock", "UseLock", "Verbose", "NoProbeCache", "NoRunCache"});
+	Key = HashString(KeySource);
+	if (!Using) return true;
+
+	std::ifstream Input(Location.AsAbsoluteString().c_str());
+	String Line;
+	if (!std::getline(Input, Line) || (Line != LockFormat))
+	{
+		if (Verbose) StandardStream << "No usable lock at " << Location << "; every query will be discovered.\n" << OutputStream::Flush();
+		return true;
+	}
+	if (!std::getline(Input, Line) || (Line != "K " + Key))
+	{
+		if (Verbose) StandardStream << "The lock at " << Location << " was made with different configuration or environment variables; every query will be discovered.\n" << OutputStream::Flush();
+		return true;
+	}
+	std::vector<String> Paths, Fingerprints;
+	std::vector<Query> Loaded;
+	while (std::getline(Input, Line))
+	{
+		if (Line.length() < 2) continue;
+		String First, Second;
+		if (Line[0] == 'D')
+		{
+			if (!SplitPair(Line, First, Second)) continue;
+			Paths.push_back(First);
+			Fingerprints.push_back(Second);
+		}
+		else if (Line[0] == 'Q') Loaded.push_back(Query{UnescapeCacheField(Line.substr(2)), {}, String(), {}, {}, false, true});
+		else if (Loaded.empty()) continue;
+		else if (Line[0] == 'A')
+		{
+			if (SplitPair(Line, First, Second)) Loaded.back().Arguments.push_back(std::make_pair(First, Second));
+		}
+		else if (Line[0] == 'F')
+		{
+			// Indices of D lines, separated by spaces
+			char const *Position = Line.c_str() + 2;
+			while (*Position != '\0')
+			{
+				char *End;
+				unsigned long const Index = strtoul(Position, &End, 10);
+				if (End == Position) break;
+				Position = End;
+				if (Index < Paths.size()) Loaded.back().Facts.push_back(Paths[Index]);
+				else Loaded.back().Valid = false;
+			}
+		}
+		else if (Line[0] == 'U') Loaded.back().Stateful.push_back(UnescapeCacheField(Line.substr(2)));
+		else if (Line[0] == 'R') Loaded.back().Serialized = Line.substr(2);
+	}
+
+	std::vector<String> Current;
+	FingerprintAll(Paths, Current);
+	std::set<String> Changed;
+	for (size_t Index = 0; Index < Paths.size(); ++Index)
+	{
+		if (Current[Index] == Fingerprints[Index])
+		{
+			Dependencies[Paths[Index]] = Fingerprints[Index];
+			continue;
+		}
+		Changed.insert(Paths[Index]);
+		if (Verbose) StandardStream << "Locked fact \"" << Paths[Index] << "\" changed.\n" << OutputStream::Flush();
+	}
+	for (auto &Candidate : Loaded)
+		for (auto &Fact : Candidate.Facts)
+			if (Changed.find(Fact) != Changed.end()) Candidate.Valid = false;
+	// A query discovered again may need the state an earlier query left in an item it uses, like the compiler CXXCompiler found, so that query is discovered again too
+	for (size_t Index = Loaded.size(); Index > 0; --Index)
+	{
+		Query const &Candidate = Loaded[Index - 1];
+		if (Candidate.Valid) continue;
+		for (auto &Identifier : Candidate.Stateful)
+			for (size_t Earlier = Index - 1; Earlier > 0; --Earlier)
+				if (Loaded[Earlier - 1].Identifier == Identifier)
+				{
+					Loaded[Earlier - 1].Valid = false;
+					break;
+				}
+	}
+	if (Verbose)
+	{
+		size_t const Stale = std::count_if(Loaded.begin(), Loaded.end(), [](Query const &Candidate) { return !Candidate.Valid; });
+		StandardStream << "Checked " << Paths.size() << " facts for " << Loaded.size() << " locked queries in " << Location << "; " << Stale << " will be discovered again.\n" << OutputStream::Flush();
+	}
+	Locked.swap(Loaded);
+	return true;
+}
+
+bool LockFile::Find(String const &Identifier, QueryState &State, Response &Result)
+{
+	if (!Using) return false;
+	for (auto &Candidate : Locked)
+	{
+		if (Candidate.Used || (Candidate.Identifier != Identifier) || !State.MatchArguments(Candidate.Arguments)) continue;
+		Candidate.Used = true;
+		if (!Candidate.Valid || !DeserializeResponse(Candidate.Serialized, Result))
+		{
+			if (Verbose) StandardStream << "The locked answer to this Discover." << Identifier << " query is out of date.\n" << OutputStream::Flush();
+			return false;
+		}
+		if (Recording) Queries.push_back(Candidate);
+		if (Verbose) StandardStream << "Answered Discover." << Identifier << " from the lock.\n" << OutputStream::Flush();
+		return true;
+	}
+	if (Verbose) StandardStream << "The lock has no answer for this Discover." << Identifier << " query.\n" << OutputStream::Flush();
+	return false;
+}
+
+void LockFile::Record(String const &Identifier, QueryState const &State, std::set<String> const &Facts, std::vector<String> const &Stateful)
+{
+	if (!Recording) return;
+	Queries.push_back(Query{Identifier, State.GetArguments(), SerializeResponse(State.GetResponse()), std::vector<String>(Facts.begin(), Facts.end()), Stateful, true, true});
+}
+
+void LockFile::AddDependency(String const &Path)
+{
+	if (!Recording || (Dependencies.find(Path) != Dependencies.end())) return;
+	Dependencies[Path] = FingerprintPath(Path);
+}
+
+void LockFile::Save(void)
+{
+	if (!Recording) return;
+
+	// Only the facts some query depends on are written, numbered in the order they're first needed
+	std::map<String, size_t> Numbers;
+	std::vector<String> Paths;
+	for (auto &Current : Queries)
+		for (auto &Fact : Current.Facts)
+			if (Numbers.insert(std::make_pair(Fact, Paths.size())).second) Paths.push_back(Fact);
+
+	MemoryStream Output;
+	Output << LockFormat << "\n" << "K " << Key << "\n";
+	for (auto &Path : Paths)
+	{
+		auto Found = Dependencies.find(Path);
+		Output << "D " << EscapeCacheField(Path) << "\t" << EscapeCacheField(Found == Dependencies.end() ? FingerprintPath(Path) : Found->second) << "\n";
+	}
+	for (auto &Current : Queries)
+	{
+		Output << "Q " << EscapeCacheField(Current.Identifier) << "\n";
+		for (auto &Argument : Current.Arguments)
+			Output << "A " << EscapeCacheField(Argument.first) << "\t" << EscapeCacheField(Argument.second) << "\n";
+		if (!Current.Facts.empty())
+		{
+			Output << "F";
+			for (auto &Fact : Current.Facts) Output << " " << Numbers[Fact];
+			Output << "\n";
+		}
+		for (auto &Identifier : Current.Stateful)
+			Output << "U " << EscapeCacheField(Identifier) << "\n";
+		Output << "R " << Current.Serialized << "\n";
+	}
+	if (!ReplaceCacheFile(Location, Output)) throw InteractionError("Couldn't write lock " + Location.AsAbsoluteString() + ".");
+	if (Verbose) StandardStream << "Locked " << Queries.size() << " queries and " << Paths.size() << " facts in " << Location << ".\n" << OutputStream::Flush();
+}
+
+FilePath const &LockFile::GetLocation(void) const { return Location; }
+
@@ -0,0 +1,97 @@
+#ifndef RUNCACHE_H
+#define RUNCACHE_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "ren-general/string.h"
+#include "ren-general/filesystem.h"
+
+struct Response;
+class QueryState;
+
+// Notes that the query being answered depends on the file or directory at Path.  A directory stands for the names in it, so adding or removing a file changes it.
+void RecordDependency(String const &Path);
+
+// Collects the dependencies noted while it's the innermost scope into Paths, and passes them on to the scopes it's within
+class DependencyScope
+{
+	public:
+		DependencyScope(std::set<String> &Paths);
+		~DependencyScope(void);
+		static void Note(String const &Path);
+		static void Note(std::set<String> const &Paths);
+
+	private:
+		std::set<String> &Paths;
+		DependencyScope *const Outer;
+		static DependencyScope *Current;
+};
+
+// Remembers every query each controller made and the responses, so a rerun can be answered without any discovery.  Controllers are kept in separate sections of one file.  The recorded run is used only if the controller, configuration, relevant environment variables, boot, and CPU affinity are the same, and every file and directory a query depended on still has the same fingerprint.
+class RunCache
+{
+	public:
+		RunCache(FilePath const &Location);
+		// Works out the key for this run and loads the recorded run if it's still valid
+		void Begin(FilePath const &Controller);
+		// Puts the response to the first unused recorded query of Identifier with the same arguments in Result; returns false if there is none
+		bool Find(String const &Identifier, QueryState &State, Response &Result);
+		void Record(String const &Identifier, QueryState const &State);
+		void AddDependency(String const &Path);
+		void Save(void); // Only call once the controller finished
+		FilePath const &GetLocation(void) const;
+
+	private:
+		struct Query
+		{
+			String Identifier;
+			std::vector<std::pair<String, String> > Arguments;
+			String Serialized; // The response
+			bool Used;
+		};
+
+		FilePath const Location;
+		bool Enabled, Changed;
+		String Controller; // Absolute path, naming this run's section of the cache
+		String Key;
+		std::vector<Query> Recorded; // From the earlier run
+		std::vector<Query> Queries; // From this run, in order
+		std::map<String, String> Dependencies; // Paths and their fingerprints, taken when the dependency was first noted
+};
+
+// With Lock, records every query, its response, and the files and directories the response depended on.  With UseLock, checks all those facts at once and replays the responses whose facts still hold; only the queries with a changed fact are discovered again.  Unlike the run cache, a lock doesn't depend on the controller or the boot, so responses that don't come from files, like CPU's, are replayed as they were recorded.  Items whose answers vary between runs, like Parallelism, are always discovered.
+class LockFile
+{
+	public:
+		LockFile(FilePath const &Location);
+		bool Begin(void); // Returns false if neither Lock nor UseLock was configured
+		// Puts the response to the first unused locked query of Identifier with the same arguments in Result if all its facts still hold; returns false otherwise
+		bool Find(String const &Identifier, QueryState &State, Response &Result);
+		// Stateful lists the items used by the query whose answers change what they tell other items
+		void Record(String const &Identifier, QueryState const &State, std::set<String> const &Facts, std::vector<String> const &Stateful);
+		void AddDependency(String const &Path);
+		void Save(void); // Only call once the controller finished
+		FilePath const &GetLocation(void) const;
+
+	private:
+		struct Query
+		{
+			String Identifier;
+			std::vector<std::pair<String, String> > Arguments;
+			String Serialized;
+			std::vector<String> Facts, Stateful;
+			bool Used, Valid;
+		};
+
+		FilePath const Location;
+		bool Recording, Using;
+		String Key;
+		std::vector<Query> Locked; // From the lock file
+		std::vector<Query> Queries; // For the new lock file, in order
+		std::map<String, String> Dependencies; // Paths and their fingerprints
+};
+
+#endif // RUNCACHE_H
+
@@ -2,6 +2,8 @@
 
 #include <unistd.h>
 #include <iostream>
+#include <fstream>
+#include <cstdlib>
 #include <cstring>
 #ifdef _WIN32
 #include <fcntl.h>
@@ -72,3 +74,31 @@ bool StringSplitter::Finished(void) { return !HotSlash && !HotQuote; }
 
 std::queue<String> &StringSplitter::Results(void) { return Out; }
 
+String ReadFirstLine(String const &Path)
+{
+	std::ifstream Input(Path.c_str());
+	String Line;
+	std::getline(Input, Line);
+	return Line;
+}
+
+unsigned long long ParseSize(String const &Text)
+{
+	char *End = nullptr;
+	unsigned long long Out = strtoull(Text.c_str(), &End, 10);
+	if ((End == nullptr) || (End == Text.c_str())) return 0;
+	switch (*End)
+	{
+		case 'k': case 'K': return Out * 1024;
+		case 'm': case 'M': return Out * 1024 * 1024;
+		case 'g': case 'G': return Out * 1024 * 1024 * 1024;
+		default: return Out;
+	}
+}
+
+DirectoryPath FindExistingAncestor(DirectoryPath Directory)
+{
+	while (!Directory.Exists() && !Directory.IsRoot()) Directory = Directory.Exit();
+	return Directory;
+}
+
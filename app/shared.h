@@ -31,4 +31,8 @@ class StringSplitter
 		std::queue<String> Out;
 };
 
+String ReadFirstLine(String const &Path); // Empty if the file can't be read
+unsigned long long ParseSize(String const &Text); // Sizes like 48K, 2048kB, 512M, or 2G as bytes; 0 if Text isn't a size
+DirectoryPath FindExistingAncestor(DirectoryPath Directory); // The nearest existing directory at or above Directory, for directories that may not have been created yet
+
 #endif // SHARED_H
@@ -1,23 +1,46 @@
 #include "subprocess.h"
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <iostream>
 #include <cstring>
 #include <cassert>
-#ifdef _WIN32
-#include <fcntl.h>
-#else
+#ifndef _WIN32
 #include <csignal>
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#elif !defined(_WIN32)
+#include <poll.h>
 #endif
 
 #include "shared.h"
 
 extern bool Verbose;
+#ifndef _WIN32
+extern char **environ;
 
-SubprocessOutStream::SubprocessOutStream(void) : FileDescriptor(-1), Failed(true) {}
+// A pipe with both ends close-on-exec
+static bool MakePipe(int Ends[2])
+{
+#ifdef __linux__
+	return pipe2(Ends, O_CLOEXEC) == 0;
+#else
+	if (pipe(Ends) == -1) return false;
+	fcntl(Ends[0], F_SETFD, FD_CLOEXEC);
+	fcntl(Ends[1], F_SETFD, FD_CLOEXEC);
+	return true;
+#endif
+}
+#endif
+
+size_t const ReadChunkSize = 64 * 1024;
 
-SubprocessOutStream::~SubprocessOutStream(void) { /*if (FileDescriptor >= 0) close(FileDescriptor);*/ }
+SubprocessOutStream::SubprocessOutStream(void) : FileDescriptor(-1), Failed(true), Ended(true), Start(0), End(0) {}
+
+SubprocessOutStream::~SubprocessOutStream(void) { if (FileDescriptor >= 0) close(FileDescriptor); }
 
 void SubprocessOutStream::Associate(int FileDescriptor)
 {
@@ -25,46 +48,108 @@ void SubprocessOutStream::Associate(int FileDescriptor)
 	assert(FileDescriptor != -1);
 	this->FileDescriptor = FileDescriptor;
 	Failed = false;
+	Ended = false;
+	Buffer.resize(ReadChunkSize);
 }
 
-String SubprocessOutStream::ReadLine(void)
+bool SubprocessOutStream::Fill(void)
 {
-	assert(!Failed);
-	String Out;
+	if (Ended) return false;
+
+	if (Start == End) Start = End = 0;
+	if (End == Buffer.size())
+	{
+		// Make room for another chunk, either by discarding consumed data or by growing
+		if (Start > 0)
+		{
+			std::memmove(Buffer.data(), Buffer.data() + Start, End - Start);
+			End -= Start;
+			Start = 0;
+		}
+		if (Buffer.size() - End < ReadChunkSize / 2)
+			Buffer.resize(Buffer.size() * 2);
+	}
+
 	while (true)
 	{
-		char Buffer;
-		int Result = read(FileDescriptor, &Buffer, 1);
+		int Result = read(FileDescriptor, Buffer.data() + End, Buffer.size() - End);
 		if (Result == -1)
 		{
+			if (errno == EINTR) continue;
 			std::cerr << "Error: Couldn't read from subprocess due to error " << errno << ": " << strerror(errno) << std::endl;
-			Failed = true;
-			return Out;
+			Ended = true;
+			return false;
 		}
 		if (Result == 0)
 		{
+			Ended = true;
+			return false;
+		}
+		End += Result;
+		return true;
+	}
+}
+
+static void AppendWithoutCarriageReturns(String &Out, char const *Begin, char const *Finish)
+{
+	Out.reserve(Out.length() + (Finish - Begin));
+	for (char const *Character = Begin; Character != Finish; ++Character)
+		if (*Character != '\r') Out += *Character;
+}
+
+String SubprocessOutStream::ReadLine(void)
+{
+	assert(!Failed);
+	String Out;
+	size_t SearchFrom = Start;
+	while (true)
+	{
+		char const *Newline = static_cast<char const *>(memchr(Buffer.data() + SearchFrom, '\n', End - SearchFrom));
+		if (Newline != nullptr)
+		{
+			AppendWithoutCarriageReturns(Out, Buffer.data() + Start, Newline);
+			Start = Newline - Buffer.data() + 1;
+			break;
+		}
+		size_t const Consumed = Start;
+		SearchFrom = End;
+		if (!Fill())
+		{
+			AppendWithoutCarriageReturns(Out, Buffer.data() + Start, Buffer.data() + End);
+			Start = End;
 			Failed = true;
-			return Out;
+			break;
 		}
-		if (Buffer == '\r') continue;
-		if (Buffer == '\n') break;
-		Out += Buffer;
+		SearchFrom -= Consumed - Start; // Fill may have compacted the buffer
 	}
 
-	return std::move(Out);
+	return Out;
+}
+
+String SubprocessOutStream::ReadAll(void)
+{
+	if (Failed) return String();
+	while (Fill()) {}
+	String Out;
+	AppendWithoutCarriageReturns(Out, Buffer.data() + Start, Buffer.data() + End);
+	Start = End;
+	Failed = true;
+	return Out;
 }
 
 bool SubprocessOutStream::HasFailed(void) { return Failed; }
 		
 void SubprocessOutStream::ReadToEnd(void)
 {
-	while (!HasFailed())
-		ReadLine();
+	if (Failed) return;
+	while (Fill()) Start = End;
+	Start = End;
+	Failed = true;
 }
 
 SubprocessInStream::SubprocessInStream(void) : FileDescriptor(-1) {}
 
-SubprocessInStream::~SubprocessInStream(void) { /*if (FileDescriptor >= 0) close(FileDescriptor);*/ }
+SubprocessInStream::~SubprocessInStream(void) { if (FileDescriptor >= 0) close(FileDescriptor); }
 
 void SubprocessInStream::Associate(int FileDescriptor)
 {
@@ -82,11 +167,30 @@ void SubprocessInStream::Write(String const &Contents)
 	};
 
 	assert(!Contents.empty());
-	int Wrote = write(FileDescriptor, Contents.c_str(), Contents.length());
-	if (Wrote == -1) throw WriteError();
+	assert(FileDescriptor != -1);
+	size_t Written = 0;
+	while (Written < Contents.length())
+	{
+		int Wrote = write(FileDescriptor, Contents.c_str() + Written, Contents.length() - Written);
+		if (Wrote == -1)
+		{
+			if (errno == EINTR) continue;
+			// The child stopped reading, because exec failed or it rejected its arguments; its result says what happened
+			if (errno == EPIPE) return;
+			throw WriteError();
+		}
+		Written += Wrote;
+	}
 }
 
-Subprocess::Subprocess(FilePath const &Execute, std::vector<String> const &Arguments) : ResultRetrieved(false)
+void SubprocessInStream::Close(void)
+{
+	if (FileDescriptor == -1) return;
+	close(FileDescriptor);
+	FileDescriptor = -1;
+}
+
+Subprocess::Subprocess(FilePath const &Execute, std::vector<String> const &Arguments, bool CaptureError) : ResultRetrieved(false), Normal(true)
 {
 	if (Verbose)
 	{
@@ -95,7 +199,6 @@ Subprocess::Subprocess(FilePath const &Execute, std::vector<String> const &Argum
 		StandardStream << "\n" << OutputStream::Flush();
 	}
 
-	fflush(nullptr); // Write everything before forking so buffered data isn't written twice
 #ifdef WINDOWS
 	HANDLE ChildInHandle = NULL;
 	HANDLE ParentOutHandle = NULL;
@@ -156,37 +259,67 @@ Subprocess::Subprocess(FilePath const &Execute, std::vector<String> const &Argum
 	Out.Associate(ParentIn);
 	In.Associate(ParentOut);
 #else
+	// Everything the child needs is prepared before forking, since after vfork it may only make async-signal-safe calls
+	String const ExecutePath = Execute.AsAbsoluteString();
+	std::vector<char *> ArgumentVector;
+	ArgumentVector.reserve(Arguments.size() + 2);
+	ArgumentVector.push_back(const_cast<char *>(ExecutePath.c_str()));
+	for (auto &Argument : Arguments)
+		ArgumentVector.push_back(const_cast<char *>(Argument.c_str()));
+	ArgumentVector.push_back(nullptr);
+
+	// All ends are close-on-exec so concurrently spawned children don't hold each other's pipes open; dup2 clears the flag on the child's standard descriptors
 	const unsigned int WriteEnd = 1, ReadEnd = 0;
-	int FromChild[2], ToChild[2];
-	if ((pipe(FromChild) == -1) || (pipe(ToChild) == -1))
+	int FromChild[2], ErrorFromChild[2] = {-1, -1}, ToChild[2], ExecError[2];
+	if (!MakePipe(FromChild) || !MakePipe(ToChild) || !MakePipe(ExecError) || (CaptureError && !MakePipe(ErrorFromChild)))
 		throw InteractionError("Error: Failed to create pipes for communication with controller.");
 
-	ChildID = fork();
+	ChildID = vfork();
 	if (ChildID == -1) throw InteractionError("Failed to create process for controller.");
 
 	if (ChildID == 0) // Child side
 	{
-		close(ToChild[WriteEnd]);
-		dup2(ToChild[ReadEnd], 0);
-		close(ToChild[ReadEnd]);
-		close(FromChild[ReadEnd]);
-		dup2(FromChild[WriteEnd], 1);
-		close(FromChild[WriteEnd]);
-		MemoryStream FullRunLine;
-		FullRunLine << Execute.AsAbsoluteString();
-		for (auto &Argument : Arguments)
-			FullRunLine << " " << Argument;
-		int RawResult = system(((String)FullRunLine).c_str());
-		if (RawResult == -1) exit(1);
-		exit(WEXITSTATUS(RawResult));
+		// We ignore SIGPIPE (see main), but ignored signals stay ignored across exec
+		struct sigaction DefaultAction;
+		memset(&DefaultAction, 0, sizeof(DefaultAction));
+		DefaultAction.sa_handler = SIG_DFL;
+		sigaction(SIGPIPE, &DefaultAction, nullptr);
+
+		if ((dup2(ToChild[ReadEnd], 0) != -1) && (dup2(FromChild[WriteEnd], 1) != -1) &&
+			(!CaptureError || (dup2(ErrorFromChild[WriteEnd], 2) != -1)))
+			execve(ArgumentVector[0], ArgumentVector.data(), environ);
+		// Only reached if exec failed; the error pipe is still open since it's close-on-exec
+		int const ExecErrorNumber = errno;
+		if (write(ExecError[WriteEnd], &ExecErrorNumber, sizeof(ExecErrorNumber))) {}
+		_exit(127);
 	}
-	else // Parent side
+
+	// Parent side
+	close(ExecError[WriteEnd]);
+	close(ToChild[ReadEnd]);
+	In.Associate(ToChild[WriteEnd]);
+	close(FromChild[WriteEnd]);
+	Out.Associate(FromChild[ReadEnd]);
+	if (CaptureError)
 	{
-		close(ToChild[ReadEnd]);
-		In.Associate(ToChild[WriteEnd]);
+		close(ErrorFromChild[WriteEnd]);
+		Error.Associate(ErrorFromChild[ReadEnd]);
+	}
 
-		close(FromChild[WriteEnd]);
-		Out.Associate(FromChild[ReadEnd]);
+	// The error pipe closes without data when exec succeeds
+	int ExecErrorNumber = 0;
+	ssize_t ExecErrorRead;
+	do ExecErrorRead = read(ExecError[ReadEnd], &ExecErrorNumber, sizeof(ExecErrorNumber));
+	while ((ExecErrorRead == -1) && (errno == EINTR));
+	close(ExecError[ReadEnd]);
+	if (ExecErrorRead == sizeof(ExecErrorNumber))
+	{
+		// Reported like the shell reported it, so callers probing candidates move on to the next one
+		waitpid(ChildID, nullptr, 0);
+		ResultRetrieved = true;
+		Normal = false;
+		Result = 127;
+		if (Verbose) StandardStream << "Failed to execute \"" << ExecutePath << "\": error " << ExecErrorNumber << ": " << strerror(ExecErrorNumber) << "\n" << OutputStream::Flush();
 	}
 #endif
 }
@@ -220,9 +353,13 @@ int Subprocess::GetResult(void)
 #else
 		int RawStatus = 1;
 		waitpid(ChildID, &RawStatus, 0);
-		if (!WIFEXITED(RawStatus))
-			return 1; // Some error, pretend like command failed
-		Result = WEXITSTATUS(RawStatus);
+		if (WIFEXITED(RawStatus)) Result = WEXITSTATUS(RawStatus);
+		else
+		{
+			// Killed by a signal, so pretend like the command failed
+			Result = 1;
+			Normal = false;
+		}
 #endif
 		if (Verbose) StandardStream << "Execution finished with code " << Result << ".\n" << OutputStream::Flush();
 		ResultRetrieved = true;
@@ -230,3 +367,253 @@ int Subprocess::GetResult(void)
 	return Result;
 }
 
+bool Subprocess::ExitedNormally(void)
+{
+	GetResult();
+	return Normal;
+}
+
+
+#ifdef __linux__
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+namespace
+{
+	// Epoll data for a member's descriptors: member index shifted left, source in the low bits
+	enum WatchSources { WatchOut = 0, WatchError = 1, WatchExit = 2 };
+	uint64_t const WatchSourceBits = 2;
+}
+#endif
+
+SubprocessGroup::SubprocessGroup(void) : Running(0)
+{
+#ifdef __linux__
+	Poll = epoll_create1(EPOLL_CLOEXEC);
+	if (Poll == -1)
+		throw InteractionError("Failed to create event queue for subprocesses: error " + AsString(errno) + ": " + strerror(errno));
+#endif
+}
+
+SubprocessGroup::~SubprocessGroup(void)
+{
+	for (auto &Current : Members)
+		if (!Current->Finished)
+		{
+			Current->Process->Kill();
+			Forget(*Current);
+		}
+#ifdef __linux__
+	close(Poll);
+#endif
+}
+
+Subprocess &SubprocessGroup::Start(FilePath const &Execute, std::vector<String> const &Arguments)
+{
+	std::unique_ptr<Member> Adding(new Member);
+	Adding->ExitDescriptor = -1;
+	Adding->OutEnded = false;
+#ifdef _WIN32
+	Adding->Process.reset(new Subprocess(Execute, Arguments));
+	Adding->ErrorEnded = true;
+#else
+	Adding->Process.reset(new Subprocess(Execute, Arguments, true));
+	Adding->ErrorEnded = false;
+#endif
+	Adding->Exited = false;
+	Adding->Finished = false;
+	Adding->Cancelled = false;
+	Members.push_back(std::move(Adding));
+	++Running;
+	Member &Added = *Members.back();
+
+#ifdef __linux__
+	uint64_t const Index = Members.size() - 1;
+	auto Watch = [&](int Descriptor, WatchSources Source)
+	{
+		epoll_event Event;
+		Event.events = EPOLLIN;
+		Event.data.u64 = (Index << WatchSourceBits) | Source;
+		if (epoll_ctl(Poll, EPOLL_CTL_ADD, Descriptor, &Event) == -1)
+		{
+			String const Explanation = "Failed to watch subprocess: error " + AsString(errno) + ": " + strerror(errno);
+			Added.Cancelled = true;
+			Added.Process->Kill();
+			Forget(Added);
+			throw InteractionError(Explanation);
+		}
+	};
+	Watch(Added.Process->Out.FileDescriptor, WatchOut);
+	Watch(Added.Process->Error.FileDescriptor, WatchError);
+
+	// Without pidfds (before Linux 5.3) the subprocess is considered exited once both streams close
+	int const ExitDescriptor = syscall(SYS_pidfd_open, Added.Process->ChildID, 0);
+	if (ExitDescriptor != -1)
+	{
+		Added.ExitDescriptor = ExitDescriptor;
+		Watch(ExitDescriptor, WatchExit);
+	}
+#endif
+
+	return *Added.Process;
+}
+
+void SubprocessGroup::Finish(Member &Finishing)
+{
+	assert(!Finishing.Finished);
+	Finishing.Finished = true;
+	--Running;
+	if (Finishing.ExitDescriptor != -1)
+	{
+		close(Finishing.ExitDescriptor);
+		Finishing.ExitDescriptor = -1;
+	}
+}
+
+void SubprocessGroup::Forget(Member &Forgetting)
+{
+#ifdef __linux__
+	if (!Forgetting.OutEnded) epoll_ctl(Poll, EPOLL_CTL_DEL, Forgetting.Process->Out.FileDescriptor, nullptr);
+	if (!Forgetting.ErrorEnded) epoll_ctl(Poll, EPOLL_CTL_DEL, Forgetting.Process->Error.FileDescriptor, nullptr);
+	if (!Forgetting.Exited && (Forgetting.ExitDescriptor != -1)) epoll_ctl(Poll, EPOLL_CTL_DEL, Forgetting.ExitDescriptor, nullptr);
+#endif
+	Forgetting.OutEnded = Forgetting.ErrorEnded = Forgetting.Exited = true;
+	Forgetting.Process->GetResult();
+	if (!Forgetting.Finished) Finish(Forgetting);
+}
+
+Subprocess *SubprocessGroup::WaitAny(void)
+{
+#ifdef __linux__
+	epoll_event Events[32];
+	while (Finished.empty() && (Running > 0))
+	{
+		int EventCount = epoll_wait(Poll, Events, sizeof(Events) / sizeof(Events[0]), -1);
+		if (EventCount == -1)
+		{
+			if (errno == EINTR) continue;
+			throw InteractionError("Failed to wait for subprocesses: error " + AsString(errno) + ": " + strerror(errno));
+		}
+		for (int EventIndex = 0; EventIndex < EventCount; ++EventIndex)
+		{
+			Member &Current = *Members[Events[EventIndex].data.u64 >> WatchSourceBits];
+			if (Current.Finished) continue; // Cancelled while this event was pending
+			switch (Events[EventIndex].data.u64 & ((1 << WatchSourceBits) - 1))
+			{
+				case WatchOut:
+					if (Current.Process->Out.Fill()) break;
+					epoll_ctl(Poll, EPOLL_CTL_DEL, Current.Process->Out.FileDescriptor, nullptr);
+					Current.OutEnded = true;
+					break;
+				case WatchError:
+					if (Current.Process->Error.Fill()) break;
+					epoll_ctl(Poll, EPOLL_CTL_DEL, Current.Process->Error.FileDescriptor, nullptr);
+					Current.ErrorEnded = true;
+					break;
+				case WatchExit:
+					epoll_ctl(Poll, EPOLL_CTL_DEL, Current.ExitDescriptor, nullptr);
+					Current.Exited = true;
+					break;
+				default: assert(false); break;
+			}
+			if (Current.OutEnded && Current.ErrorEnded && (Current.Exited || (Current.ExitDescriptor == -1)))
+			{
+				Current.Process->GetResult();
+				Finish(Current);
+				Finished.push(&Current);
+			}
+		}
+	}
+#elif !defined(_WIN32)
+	// Without epoll, poll both streams of every running subprocess, so none is left blocked writing to a full pipe
+	while (Finished.empty() && (Running > 0))
+	{
+		std::vector<pollfd> Descriptors;
+		std::vector<std::pair<Member *, bool> > Sources; // Whether each descriptor is the member's error stream
+		for (auto &Current : Members)
+		{
+			if (Current->Finished) continue;
+			if (!Current->OutEnded)
+			{
+				Descriptors.push_back(pollfd{Current->Process->Out.FileDescriptor, POLLIN, 0});
+				Sources.push_back(std::make_pair(Current.get(), false));
+			}
+			if (!Current->ErrorEnded)
+			{
+				Descriptors.push_back(pollfd{Current->Process->Error.FileDescriptor, POLLIN, 0});
+				Sources.push_back(std::make_pair(Current.get(), true));
+			}
+		}
+		if (poll(Descriptors.data(), Descriptors.size(), -1) == -1)
+		{
+			if (errno == EINTR) continue;
+			throw InteractionError("Failed to wait for subprocesses: error " + AsString(errno) + ": " + strerror(errno));
+		}
+		for (size_t Index = 0; Index < Descriptors.size(); ++Index)
+		{
+			if (Descriptors[Index].revents == 0) continue;
+			Member &Current = *Sources[Index].first;
+			if (Sources[Index].second)
+			{
+				if (Current.Process->Error.Fill()) continue;
+				Current.ErrorEnded = true;
+			}
+			else
+			{
+				if (Current.Process->Out.Fill()) continue;
+				Current.OutEnded = true;
+			}
+			if (Current.OutEnded && Current.ErrorEnded)
+			{
+				Current.Exited = true;
+				Current.Process->GetResult();
+				Finish(Current);
+				Finished.push(&Current);
+			}
+		}
+	}
+#else
+	// No event queue here, so finish subprocesses one at a time in the order they were started; only standard output is captured, so reading it can't leave one blocked
+	if (Finished.empty())
+		for (auto &Current : Members)
+		{
+			if (Current->Finished) continue;
+			while (Current->Process->Out.Fill()) {}
+			Current->OutEnded = Current->ErrorEnded = Current->Exited = true;
+			Current->Process->GetResult();
+			Finish(*Current);
+			Finished.push(Current.get());
+			break;
+		}
+#endif
+	while (!Finished.empty() && Finished.front()->Cancelled) Finished.pop();
+	if (Finished.empty())
+	{
+		if (Running > 0) return WaitAny();
+		return nullptr;
+	}
+	Subprocess *Out = Finished.front()->Process.get();
+	Finished.pop();
+	return Out;
+}
+
+void SubprocessGroup::WaitAll(void)
+{
+	while (WaitAny() != nullptr) {}
+}
+
+void SubprocessGroup::Cancel(Subprocess &Process)
+{
+	for (auto &Current : Members)
+	{
+		if (Current->Process.get() != &Process) continue;
+		Current->Cancelled = true;
+		if (Current->Finished) return;
+		if (Verbose) StandardStream << "Cancelling subprocess.\n" << OutputStream::Flush();
+		Current->Process->Kill();
+		Forget(*Current);
+		return;
+	}
+	assert(false);
+}
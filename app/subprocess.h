@@ -2,6 +2,7 @@
 #define SUBPROCESS_H
 
 #include <vector>
+#include <queue>
 #include <memory>
 
 #include "ren-general/string.h"
@@ -11,24 +12,36 @@ class SubprocessOutStream
 {
 	public:
 		SubprocessOutStream(void);
+		SubprocessOutStream(SubprocessOutStream const &) = delete;
+		SubprocessOutStream &operator =(SubprocessOutStream const &) = delete;
 		~SubprocessOutStream(void);
 		void Associate(int FileDescriptor);
 		String ReadLine(void);
+		String ReadAll(void); // Reads until the subprocess closes the stream, drops carriage returns
 		bool HasFailed(void);
 		void ReadToEnd(void);
 
 	private:
+		friend class SubprocessGroup;
+		bool Fill(void); // Reads one chunk into the buffer; returns false once the stream has ended
+
 		int FileDescriptor;
 		bool Failed;
+		bool Ended;
+		std::vector<char> Buffer;
+		size_t Start, End; // Unread data is [Start, End)
 };
 
 class SubprocessInStream
 {
 	public:
 		SubprocessInStream(void);
+		SubprocessInStream(SubprocessInStream const &) = delete;
+		SubprocessInStream &operator =(SubprocessInStream const &) = delete;
 		~SubprocessInStream(void);
 		void Associate(int FileDescriptor);
 		void Write(String const &Contents = String("\n"));
+		void Close(void); // Sends end of file to the subprocess
 	private:
 		int FileDescriptor;
 };
@@ -36,20 +49,53 @@ class SubprocessInStream
 class Subprocess
 {
 	public:
-		Subprocess(FilePath const &Execute, std::vector<String> const &Arguments);
+		// If CaptureError is set, the child's standard error goes to Error rather than ours (POSIX only).  Error must then be drained along with Out or the child may block, so this is only used by SubprocessGroup.
+		Subprocess(FilePath const &Execute, std::vector<String> const &Arguments, bool CaptureError = false);
 		~Subprocess(void);
 		SubprocessOutStream Out;
+		SubprocessOutStream Error;
 		SubprocessInStream In;
 		void Kill(void);
 		int GetResult(void);
+		bool ExitedNormally(void); // Waits like GetResult; false if the program couldn't be run (a result of 127) or was killed by a signal
 	private:
+		friend class SubprocessGroup;
 #ifdef _WIN32
 		PROCESS_INFORMATION ChildStatus;
 #else
 		pid_t ChildID;
 #endif
-		bool ResultRetrieved;
+		bool ResultRetrieved, Normal;
 		int Result;
 };
 
-#endif // SHARED_H
+// Runs many subprocesses at once, buffering their output as it arrives.  A subprocess returned by WaitAny has exited and its streams have been read to the end, so reads on them won't block.
+class SubprocessGroup
+{
+	public:
+		SubprocessGroup(void);
+		SubprocessGroup(SubprocessGroup const &) = delete;
+		SubprocessGroup &operator =(SubprocessGroup const &) = delete;
+		~SubprocessGroup(void); // Kills and reaps anything still running
+		Subprocess &Start(FilePath const &Execute, std::vector<String> const &Arguments); // The result lives as long as the group
+		Subprocess *WaitAny(void); // Returns nullptr once every started subprocess has been returned or cancelled
+		void WaitAll(void);
+		void Cancel(Subprocess &Process); // Kills the subprocess, which won't be returned by WaitAny
+	private:
+		struct Member
+		{
+			std::unique_ptr<Subprocess> Process;
+			int ExitDescriptor;
+			bool OutEnded, ErrorEnded, Exited, Finished, Cancelled;
+		};
+		void Finish(Member &Finishing);
+		void Forget(Member &Forgetting);
+		std::vector<std::unique_ptr<Member>> Members;
+		std::queue<Member *> Finished;
+		unsigned int Running;
+#ifdef __linux__
+		int Poll;
+#endif
+};
+
+#endif // SUBPROCESS_H
@@ -21,3 +21,36 @@ print('C++ compiler location name, path: ' .. CXXCompiler.Name .. ', ' .. CXXCom
 CXX11Compiler = Discover.CXXCompiler{CXX11 = true}
 print('C++11 compiler location name, path: ' .. CXX11Compiler.Name .. ', ' .. CXX11Compiler.Path)
 
+if CXXCompiler.Features then
+	for Index, Flag in ipairs({'CXX11', 'CXX14', 'CXX17', 'CXX20', 'CXX23', 'HasInclude'}) do
+		print('C++ compiler supports ' .. Flag .. ': ' .. tostring(CXXCompiler.Features[Flag]))
+	end
+	print('C++ compiler pointer size: ' .. tostring(CXXCompiler.Features.Macros.__SIZEOF_POINTER__))
+end
+
+CPU = Discover.CPU{}
+if CPU then print('CPU vendor, level: ' .. tostring(CPU.Vendor) .. ', ' .. tostring(CPU.Level)) end
+
+Topology = Discover.Topology{}
+if Topology then print('Cache line size, L1 size: ' .. tostring(Topology.CacheLineSize) .. ', ' .. tostring(Topology.L1Size)) end
+
+Parallelism = Discover.Parallelism{}
+if Parallelism then print('CPUs, compile jobs, link jobs: ' .. Parallelism.CPUs .. ', ' .. Parallelism.CompileJobs .. ', ' .. Parallelism.LinkJobs) end
+
+Linker = Discover.Linker{}
+if Linker then print('Linker: ' .. tostring(Linker.Name)) end
+
+CompilerCache = Discover.CompilerCache{}
+if CompilerCache then print('Compiler cache: ' .. tostring(CompilerCache.Name)) end
+
+Optimization = Discover.Optimization{}
+if Optimization then print('C++ compiler supports LTO: ' .. tostring(Optimization.LTO)) end
+
+Allocator = Discover.Allocator{}
+if Allocator then print('Allocator: ' .. tostring(Allocator.Name)) end
+
+Filesystem = Discover.Filesystem{Path = '.'}
+if Filesystem then print('Filesystem type, writable: ' .. tostring(Filesystem.Type) .. ', ' .. tostring(Filesystem.Writable)) end
+
+Kernel = Discover.Kernel{}
+if Kernel then print('Kernel supports io_uring: ' .. tostring(Kernel.IOUring)) end